@@ -0,0 +1,367 @@
+/**
+ * @file   ledmsg_client.c
+ * @author David Good
+ * @date   16 October 2026
+ * @version 0.1
+ * @brief  Client library for the ledmsgchar LKM, see ledmsg_client.h.
+ * Encoding is a table lookup per byte of pixels, so building a frame costs
+ * about as much as copying it, and a batch of frames goes to the driver in a
+ * single writev().
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "ledmsg_client.h"
+
+/* Hex digit pairs of every byte value, upper case like the driver always took */
+#define HEX_ROW(h) h "0" h "1" h "2" h "3" h "4" h "5" h "6" h "7" \
+                   h "8" h "9" h "A" h "B" h "C" h "D" h "E" h "F"
+static const char hexPairs[256 * 2 + 1] =
+    HEX_ROW("0") HEX_ROW("1") HEX_ROW("2") HEX_ROW("3") HEX_ROW("4") HEX_ROW("5") HEX_ROW("6") HEX_ROW("7")
+    HEX_ROW("8") HEX_ROW("9") HEX_ROW("A") HEX_ROW("B") HEX_ROW("C") HEX_ROW("D") HEX_ROW("E") HEX_ROW("F");
+
+/* Gray pixels of every nibble value, the most significant bit is the leftmost pixel */
+static const uint8_t grayNibbles[16][4] = {
+    {0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x00, 0xff}, {0x00, 0x00, 0xff, 0x00}, {0x00, 0x00, 0xff, 0xff},
+    {0x00, 0xff, 0x00, 0x00}, {0x00, 0xff, 0x00, 0xff}, {0x00, 0xff, 0xff, 0x00}, {0x00, 0xff, 0xff, 0xff},
+    {0xff, 0x00, 0x00, 0x00}, {0xff, 0x00, 0x00, 0xff}, {0xff, 0x00, 0xff, 0x00}, {0xff, 0x00, 0xff, 0xff},
+    {0xff, 0xff, 0x00, 0x00}, {0xff, 0xff, 0x00, 0xff}, {0xff, 0xff, 0xff, 0x00}, {0xff, 0xff, 0xff, 0xff},
+};
+
+/** @brief Allocates a blank image
+ *  @param img The image to set up
+ *  @param width Width in pixels
+ *  @param height Height in pixels
+ *  @return 0 if successful, -ENOMEM otherwise
+ */
+int ledmsg_image_init(struct ledmsg_image *img, unsigned int width, unsigned int height) {
+    img->width = width;
+    img->height = height;
+    img->rowBytes = (width + 7) / 8;
+    img->data = calloc((size_t)img->rowBytes * height ?: 1, 1);
+    return img->data ? 0 : -ENOMEM;
+}
+
+/** @brief Frees what ledmsg_image_init() allocated
+ *  @param img The image
+ */
+void ledmsg_image_free(struct ledmsg_image *img) {
+    free(img->data);
+    img->data = NULL;
+}
+
+/** @brief Turns every pixel of an image off or on
+ *  @param img The image
+ *  @param on Whether the pixels are lit
+ */
+void ledmsg_image_clear(struct ledmsg_image *img, bool on) {
+    memset(img->data, on ? 0xff : 0x00, (size_t)img->rowBytes * img->height);
+}
+
+/** @brief Sets one pixel, pixels outside the image are ignored
+ *  @param img The image
+ *  @param x Column, 0 is the left edge
+ *  @param y Row, 0 is the top edge
+ *  @param on Whether the pixel is lit
+ */
+void ledmsg_set_pixel(struct ledmsg_image *img, unsigned int x, unsigned int y, bool on) {
+    uint8_t *byte;
+
+    if (x >= img->width || y >= img->height)
+        return;
+    byte = img->data + y * img->rowBytes + x / 8;
+    if (on)
+        *byte |= 0x80 >> (x & 7);
+    else
+        *byte &= ~(0x80 >> (x & 7));
+}
+
+/** @brief Reads one pixel
+ *  @param img The image
+ *  @param x Column, 0 is the left edge
+ *  @param y Row, 0 is the top edge
+ *  @return Whether the pixel is lit, false outside the image
+ */
+bool ledmsg_get_pixel(const struct ledmsg_image *img, unsigned int x, unsigned int y) {
+    if (x >= img->width || y >= img->height)
+        return false;
+    return img->data[y * img->rowBytes + x / 8] & (0x80 >> (x & 7));
+}
+
+/** @brief Turns a whole row of an image off or on
+ *  @param img The image
+ *  @param y Row, ignored if outside the image
+ *  @param on Whether the pixels are lit
+ */
+void ledmsg_fill_row(struct ledmsg_image *img, unsigned int y, bool on) {
+    if (y < img->height)
+        memset(img->data + y * img->rowBytes, on ? 0xff : 0x00, img->rowBytes);
+}
+
+/** @brief Turns a whole column of an image off or on
+ *  @param img The image
+ *  @param x Column, ignored if outside the image
+ *  @param on Whether the pixels are lit
+ */
+void ledmsg_fill_col(struct ledmsg_image *img, unsigned int x, bool on) {
+    unsigned int y;
+
+    for (y = 0; y < img->height; ++y)
+        ledmsg_set_pixel(img, x, y, on);
+}
+
+/** @brief Draws a bitmap into an image, lit and dark pixels alike
+ *  The bitmap is clipped to the image, so it may hang over any edge.
+ *  @param img The image to draw into
+ *  @param x Column of the bitmap's left edge, may be negative
+ *  @param y Row of the bitmap's top edge, may be negative
+ *  @param src The bitmap
+ */
+void ledmsg_blit(struct ledmsg_image *img, int x, int y, const struct ledmsg_image *src) {
+    unsigned int sx, sy;
+
+    for (sy = 0; sy < src->height; ++sy) {
+        if (y + (int)sy < 0 || y + (int)sy >= (int)img->height)
+            continue;
+        for (sx = 0; sx < src->width; ++sx)
+            if (x + (int)sx >= 0)
+                ledmsg_set_pixel(img, x + sx, y + sy, ledmsg_get_pixel(src, sx, sy));
+    }
+}
+
+/** @brief Encodes an image as LEDMSG_FMT_HEX, two upper case characters per byte
+ *  @param img The image
+ *  @param out Room for rowBytes * height * 2 characters, not NUL terminated
+ *  @return Characters written
+ */
+size_t ledmsg_image_encode_hex(const struct ledmsg_image *img, char *out) {
+    size_t numBytes = (size_t)img->rowBytes * img->height;
+    const uint8_t *data = img->data;
+    size_t i;
+
+    for (i = 0; i < numBytes; ++i, out += 2)
+        memcpy(out, hexPairs + 2 * data[i], 2);
+    return numBytes * 2;
+}
+
+/** @brief Encodes an image as LEDMSG_FMT_BINARY, which is its own layout
+ *  @param img The image
+ *  @param out Room for rowBytes * height bytes
+ *  @return Bytes written
+ */
+size_t ledmsg_image_encode_binary(const struct ledmsg_image *img, uint8_t *out) {
+    size_t numBytes = (size_t)img->rowBytes * img->height;
+
+    memcpy(out, img->data, numBytes);
+    return numBytes;
+}
+
+/** @brief Encodes an image as LEDMSG_FMT_GRAY, lit pixels full on
+ *  @param img The image
+ *  @param out Room for rowBytes * 8 * height bytes
+ *  @return Bytes written
+ */
+size_t ledmsg_image_encode_gray(const struct ledmsg_image *img, uint8_t *out) {
+    size_t numBytes = (size_t)img->rowBytes * img->height;
+    const uint8_t *data = img->data;
+    size_t i;
+
+    for (i = 0; i < numBytes; ++i, out += 8) {
+        memcpy(out, grayNibbles[data[i] >> 4], 4);
+        memcpy(out + 4, grayNibbles[data[i] & 0xf], 4);
+    }
+    return numBytes * 8;
+}
+
+/** @brief Internal: Encodes an image in the client's format
+ *  @param client The client
+ *  @param img The image, the size of the canvas
+ *  @param out Room for client->frameSize bytes
+ */
+static void encode_frame(const struct ledmsg_client *client, const struct ledmsg_image *img, char *out) {
+    switch (client->format) {
+    case LEDMSG_FMT_BINARY:
+        ledmsg_image_encode_binary(img, (uint8_t *)out);
+        break;
+    case LEDMSG_FMT_GRAY:
+        ledmsg_image_encode_gray(img, (uint8_t *)out);
+        break;
+    default:
+        ledmsg_image_encode_hex(img, out);
+    }
+}
+
+/** @brief Internal: Makes sure the client's buffer holds a number of frames
+ *  @param client The client
+ *  @param count Frames
+ *  @return 0 if successful, -ENOMEM otherwise
+ */
+static int reserve_frames(struct ledmsg_client *client, unsigned int count) {
+    size_t size = client->frameSize * count;
+    char *buf;
+
+    if (size <= client->bufSize)
+        return 0;
+    buf = realloc(client->buf, size);
+    if (!buf)
+        return -ENOMEM;
+    client->buf = buf;
+    client->bufSize = size;
+    return 0;
+}
+
+/** @brief Opens a panel, or a stand-in for one
+ *  A character device is asked for its geometry and set to the format. For
+ *  anything else, such as a FIFO read by a test program, the standard panel is
+ *  assumed.
+ *
+ *  @param client The client to set up
+ *  @param path The device, e.g. /dev/ledmsgchar0
+ *  @param format LEDMSG_FMT_HEX, LEDMSG_FMT_BINARY or LEDMSG_FMT_GRAY
+ *  @return 0 if successful, a negative errno otherwise
+ */
+int ledmsg_open(struct ledmsg_client *client, const char *path, int format) {
+    struct stat st;
+    int ret;
+
+    memset(client, 0, sizeof *client);
+    client->fd = -1;
+    if (format != LEDMSG_FMT_HEX && format != LEDMSG_FMT_BINARY && format != LEDMSG_FMT_GRAY)
+        return -EINVAL;
+    if (stat(path, &st))
+        return -errno;
+    client->isDevice = S_ISCHR(st.st_mode);
+    client->fd = open(path, client->isDevice ? O_RDWR : O_WRONLY);
+    if (client->fd < 0)
+        return -errno;
+    if (client->isDevice) {
+        if (ioctl(client->fd, LEDMSG_IOC_GET_GEOMETRY, &client->geometry) ||
+            ioctl(client->fd, LEDMSG_IOC_SET_FORMAT, &format)) {
+            ret = -errno;
+            ledmsg_close(client);
+            return ret;
+        }
+    } else {
+        client->geometry.rows = LEDMSG_NUM_ROWS;
+        client->geometry.cols = LEDMSG_NUM_COLS;
+        client->geometry.canvasWidth = LEDMSG_NUM_COLS;
+        client->geometry.canvasHeight = LEDMSG_NUM_ROWS;
+        client->geometry.numPanels = 1;
+    }
+    client->format = format;
+    client->frameSize = (size_t)client->geometry.canvasWidth / 8 * client->geometry.canvasHeight;
+    if (format == LEDMSG_FMT_HEX)
+        client->frameSize *= 2;
+    else if (format == LEDMSG_FMT_GRAY)
+        client->frameSize *= 8;
+    ret = reserve_frames(client, 1);
+    if (ret)
+        ledmsg_close(client);
+    return ret;
+}
+
+/** @brief Closes what ledmsg_open() opened
+ *  @param client The client
+ */
+void ledmsg_close(struct ledmsg_client *client) {
+    if (client->fd >= 0)
+        close(client->fd);
+    free(client->buf);
+    client->fd = -1;
+    client->buf = NULL;
+    client->bufSize = 0;
+}
+
+/** @brief Allocates a blank image the size of the client's frames
+ *  @param client The client
+ *  @param img The image to set up, free it with ledmsg_image_free()
+ *  @return 0 if successful, -ENOMEM otherwise
+ */
+int ledmsg_frame_image(const struct ledmsg_client *client, struct ledmsg_image *img) {
+    return ledmsg_image_init(img, client->geometry.canvasWidth, client->geometry.canvasHeight);
+}
+
+/** @brief Encodes an image and writes it as one frame
+ *  A device takes a frame whole or not at all. A short write to anything else
+ *  is carried on with.
+ *
+ *  @param client The client
+ *  @param img The image, the size of the canvas
+ *  @return 0 if successful, a negative errno otherwise
+ */
+int ledmsg_write_frame(struct ledmsg_client *client, const struct ledmsg_image *img) {
+    size_t done = 0;
+    ssize_t n;
+
+    if (img->width != client->geometry.canvasWidth || img->height != client->geometry.canvasHeight)
+        return -EINVAL;
+    encode_frame(client, img, client->buf);
+    while (done < client->frameSize) {
+        n = write(client->fd, client->buf + done, client->frameSize - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return n ? -errno : -EIO;
+        if (client->isDevice && (size_t)n != client->frameSize)
+            return -EIO;
+        done += n;
+    }
+    return 0;
+}
+
+/** @brief Encodes several images and writes them as frames with as few writev() calls as possible
+ *  The driver takes each segment as a frame of its own, in order. A device
+ *  in LEDMSG_WRITE_BLOCK mode shows every one of them for at least a scan of
+ *  the panel, in LEDMSG_WRITE_LATEST mode only the last is sure to be shown.
+ *
+ *  @param client The client
+ *  @param imgs The images, each the size of the canvas
+ *  @param count Number of images
+ *  @return 0 if all were written, a negative errno otherwise
+ */
+int ledmsg_write_frames(struct ledmsg_client *client, const struct ledmsg_image *imgs, unsigned int count) {
+    struct iovec iov[64];
+    unsigned int i, first, numIov;
+    size_t skip;
+    ssize_t n;
+    int ret;
+
+    for (i = 0; i < count; ++i)
+        if (imgs[i].width != client->geometry.canvasWidth || imgs[i].height != client->geometry.canvasHeight)
+            return -EINVAL;
+    ret = reserve_frames(client, count);
+    if (ret)
+        return ret;
+    for (i = 0; i < count; ++i)
+        encode_frame(client, &imgs[i], client->buf + i * client->frameSize);
+
+    first = 0;
+    skip = 0;                           // Bytes of frame first written already
+    while (first < count) {
+        numIov = count - first;
+        if (numIov > sizeof(iov) / sizeof(iov[0]))
+            numIov = sizeof(iov) / sizeof(iov[0]);
+        for (i = 0; i < numIov; ++i) {
+            iov[i].iov_base = client->buf + (first + i) * client->frameSize;
+            iov[i].iov_len = client->frameSize;
+        }
+        iov[0].iov_base = (char *)iov[0].iov_base + skip;
+        iov[0].iov_len -= skip;
+        n = writev(client->fd, iov, numIov);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return n ? -errno : -EIO;
+        if (client->isDevice && n % client->frameSize)
+            return -EIO;                // A device would take the rest as a frame of its own
+        n += skip;
+        first += n / client->frameSize;
+        skip = n % client->frameSize;
+    }
+    return 0;
+}
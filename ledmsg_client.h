@@ -0,0 +1,66 @@
+/**
+ * @file   ledmsg_client.h
+ * @author David Good
+ * @date   16 October 2026
+ * @version 0.1
+ * @brief  Client library for the ledmsgchar LKM: 1 bit images in the driver's
+ * frame layout, drawing helpers, table driven encoders for the write()
+ * formats and single or batched frame submission. Works on a /dev/ledmsgcharN
+ * or on anything else that takes write(), such as a FIFO standing in for the
+ * device, in which case the standard panel geometry is assumed.
+ * Build with "make libledmsg.a" and link with -L. -lledmsg.
+ */
+#ifndef LEDMSG_CLIENT_H
+#define LEDMSG_CLIENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ledmsgchar.h"
+
+/** @brief A 1 bit image in the LEDMSG_FMT_BINARY layout
+ *  Rows are rowBytes bytes, row 0 first, with the leftmost pixel of each
+ *  byte in its most significant bit. An image the size of the canvas is a
+ *  frame; a smaller one can be drawn into a frame with ledmsg_blit().
+ */
+struct ledmsg_image {
+    unsigned int width;                 ///< Width in pixels
+    unsigned int height;                ///< Height in pixels
+    unsigned int rowBytes;              ///< Bytes per row, width rounded up to whole bytes
+    uint8_t *data;                      ///< height * rowBytes bytes of pixels
+};
+
+/** @brief An open device, or a stand-in for one */
+struct ledmsg_client {
+    int fd;                             ///< The open file
+    bool isDevice;                      ///< Whether fd is a ledmsgchar device, which takes ioctls
+    int format;                         ///< Frame format written, one of enum ledmsg_format but LEDMSG_FMT_TEXT
+    struct ledmsg_geometry geometry;    ///< Panel and canvas sizes
+    size_t frameSize;                   ///< Bytes of one frame in format
+    char *buf;                          ///< Encoded frames of the batch being written
+    size_t bufSize;                     ///< Room in buf
+};
+
+/* Images */
+int  ledmsg_image_init(struct ledmsg_image *img, unsigned int width, unsigned int height);
+void ledmsg_image_free(struct ledmsg_image *img);
+void ledmsg_image_clear(struct ledmsg_image *img, bool on);
+void ledmsg_set_pixel(struct ledmsg_image *img, unsigned int x, unsigned int y, bool on);
+bool ledmsg_get_pixel(const struct ledmsg_image *img, unsigned int x, unsigned int y);
+void ledmsg_fill_row(struct ledmsg_image *img, unsigned int y, bool on);
+void ledmsg_fill_col(struct ledmsg_image *img, unsigned int x, bool on);
+void ledmsg_blit(struct ledmsg_image *img, int x, int y, const struct ledmsg_image *src);
+
+/* Encoders, each writes the whole image and returns the bytes written */
+size_t ledmsg_image_encode_hex(const struct ledmsg_image *img, char *out);
+size_t ledmsg_image_encode_binary(const struct ledmsg_image *img, uint8_t *out);
+size_t ledmsg_image_encode_gray(const struct ledmsg_image *img, uint8_t *out);
+
+/* Devices */
+int  ledmsg_open(struct ledmsg_client *client, const char *path, int format);
+void ledmsg_close(struct ledmsg_client *client);
+int  ledmsg_frame_image(const struct ledmsg_client *client, struct ledmsg_image *img);
+int  ledmsg_write_frame(struct ledmsg_client *client, const struct ledmsg_image *img);
+int  ledmsg_write_frames(struct ledmsg_client *client, const struct ledmsg_image *imgs, unsigned int count);
+
+#endif /* LEDMSG_CLIENT_H */
@@ -0,0 +1,211 @@
+/**
+ * @file   ledmsg_compat.h
+ * @author David Good
+ * @date   16 October 2026
+ * @version 0.1
+ * @brief  Userspace stand-ins for the kernel APIs ledmsg_core.c uses, so the
+ * scan engine builds into the simulator and benchmark. Only what the core
+ * needs is here. Locks are real (pthread spinlocks) so the core can be driven
+ * from several threads; mutexes and wait queues are empty since the core only
+ * initializes and wakes them.
+ */
+#ifndef LEDMSG_COMPAT_H
+#define LEDMSG_COMPAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t  s32;
+typedef int64_t  s64;
+
+/* Logging */
+#define KERN_ALERT ""
+#define KERN_INFO  ""
+#define printk(...) fprintf(stderr, __VA_ARGS__)
+#define pr_debug(...) do { } while (0)
+
+/* Helpers from linux/kernel.h, linux/minmax.h and linux/bits.h */
+#define BIT(n)              (1UL << (n))
+#define BIT_ULL(n)          (1ULL << (n))
+#define GENMASK_ULL(h, l)   ((~0ULL << (l)) & (~0ULL >> (63 - (h))))
+#define U32_MAX             UINT32_MAX
+#define fls(x)              ((x) ? 32 - __builtin_clz(x) : 0)
+#define ARRAY_SIZE(a)       (sizeof(a) / sizeof((a)[0]))
+#define ALIGN(x, a)         (((x) + (a) - 1) & ~((__typeof__(x))(a) - 1))
+#define PAGE_SIZE           4096UL
+#define PAGE_ALIGN(x)       ALIGN((x), PAGE_SIZE)
+#define min_t(t, a, b)      ((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t, a, b)      ((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define max(a, b)           ((a) > (b) ? (a) : (b))
+#define clamp_t(t, v, lo, hi) min_t(t, max_t(t, v, lo), hi)
+#define READ_ONCE(x)        __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define WRITE_ONCE(x, v)    __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define container_of(p, t, m) ((t *)((char *)(p) - offsetof(t, m)))
+
+/* asm/unaligned.h */
+#define get_unaligned(p) ({ __typeof__(*(p) + 0) v_; memcpy(&v_, (p), sizeof v_); v_; }) // int sized and up
+#define put_unaligned(v, p) do { __typeof__(*(p)) v_ = (v); memcpy((p), &v_, sizeof v_); } while (0)
+static inline u64 get_unaligned_le64(const void *p) {
+    u64 v;
+
+    memcpy(&v, p, sizeof v);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+static inline void put_unaligned_le32(u32 v, void *p) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    memcpy(p, &v, sizeof v);
+}
+
+/* linux/math64.h */
+static inline s64 div_s64_rem(s64 dividend, s32 divisor, s32 *remainder) {
+    *remainder = dividend % divisor;
+    return dividend / divisor;
+}
+static inline s64 div_s64(s64 dividend, s32 divisor) { return dividend / divisor; }
+static inline u64 div_u64(u64 dividend, u32 divisor) { return dividend / divisor; }
+
+/* linux/ktime.h, on CLOCK_MONOTONIC like the kernel's */
+typedef s64 ktime_t;
+#define NSEC_PER_USEC 1000L
+#define USEC_PER_SEC  1000000L
+#define NSEC_PER_SEC  1000000000L
+static inline ktime_t ktime_get(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (s64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+#define ktime_add_ns(t, ns) ((t) + (s64)(ns))
+#define ktime_sub(a, b)     ((a) - (b))
+#define ktime_before(a, b)  ((a) < (b))
+#define ktime_to_ns(t)      (t)
+#define ktime_to_us(t)      ((t) / NSEC_PER_USEC)
+#define ns_to_ktime(ns)     ((ktime_t)(ns))
+
+/* linux/atomic.h, all sequentially consistent, which is at least what the kernel gives */
+typedef struct { int counter; } atomic_t;
+#define atomic_read(v)          __atomic_load_n(&(v)->counter, __ATOMIC_SEQ_CST)
+#define atomic_set(v, i)        __atomic_store_n(&(v)->counter, (i), __ATOMIC_SEQ_CST)
+#define atomic_xchg(v, i)       __atomic_exchange_n(&(v)->counter, (i), __ATOMIC_SEQ_CST)
+#define atomic_inc_return(v)    __atomic_add_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST)
+
+/* linux/spinlock.h, linux/mutex.h and linux/wait.h */
+typedef pthread_spinlock_t spinlock_t;
+#define spin_lock_init(l)   pthread_spin_init((l), PTHREAD_PROCESS_PRIVATE)
+#define spin_lock(l)        pthread_spin_lock(l)
+#define spin_unlock(l)      pthread_spin_unlock(l)
+struct mutex { int unused; };
+#define mutex_init(m)       do { (void)(m); } while (0)
+typedef struct { int unused; } wait_queue_head_t;
+#define init_waitqueue_head(w)     do { (void)(w); } while (0)
+#define wake_up_interruptible(w)   do { (void)(w); } while (0)
+
+/* linux/list.h, just the parts the playlists use */
+struct list_head { struct list_head *next, *prev; };
+#define LIST_HEAD(name) struct list_head name = { &(name), &(name) }
+static inline void INIT_LIST_HEAD(struct list_head *l) { l->next = l->prev = l; }
+static inline bool list_empty(const struct list_head *l) { return l->next == l; }
+static inline void list_add_tail(struct list_head *n, struct list_head *head) {
+    n->prev = head->prev;
+    n->next = head;
+    head->prev->next = n;
+    head->prev = n;
+}
+static inline void list_del(struct list_head *n) {
+    n->prev->next = n->next;
+    n->next->prev = n->prev;
+}
+static inline void list_splice_init(struct list_head *list, struct list_head *head) {
+    if (list_empty(list))
+        return;
+    list->next->prev = head;
+    list->prev->next = head->next;
+    head->next->prev = list->prev;
+    head->next = list->next;
+    INIT_LIST_HEAD(list);
+}
+#define list_first_entry(head, type, member) container_of((head)->next, type, member)
+#define list_for_each_entry(pos, head, member)                                  \
+    for (pos = container_of((head)->next, __typeof__(*pos), member);           \
+         &pos->member != (head);                                                \
+         pos = container_of(pos->member.next, __typeof__(*pos), member))
+
+/* linux/slab.h and the page allocator */
+#define GFP_KERNEL  0
+#define __GFP_ZERO  1
+static inline void *kmalloc(size_t size, int flags) { (void)flags; return malloc(size); }
+static inline void *kmalloc_array(size_t n, size_t size, int flags) { (void)flags; return malloc(n * size); }
+static inline void *kzalloc(size_t size, int flags) { (void)flags; return calloc(1, size); }
+static inline void *kcalloc(size_t n, size_t size, int flags) { (void)flags; return calloc(n, size); }
+static inline void *kvmalloc(size_t size, int flags) { (void)flags; return malloc(size); }
+static inline void *kvzalloc(size_t size, int flags) { (void)flags; return calloc(1, size); }
+static inline void *alloc_pages_exact(size_t size, int flags) {
+    void *p = aligned_alloc(PAGE_SIZE, PAGE_ALIGN(size));
+
+    if (p && (flags & __GFP_ZERO))
+        memset(p, 0, size);
+    return p;
+}
+static inline void free_pages_exact(void *p, size_t size) { (void)size; free(p); }
+#define kfree(p)    free((void *)(p))
+#define kvfree(p)   free((void *)(p))
+
+/* linux/nls.h */
+typedef u32 unicode_t;
+/** @brief Decodes one UTF-8 sequence, like the kernel's utf8_to_utf32()
+ *  @return Bytes used, or -1 if the sequence is malformed
+ */
+static inline int utf8_to_utf32(const u8 *s, int inlen, unicode_t *pu) {
+    unsigned int len, i;
+    unicode_t c;
+
+    if (inlen <= 0)
+        return -1;
+    if (s[0] < 0x80) {
+        *pu = s[0];
+        return 1;
+    }
+    if ((s[0] & 0xe0) == 0xc0)
+        len = 2, c = s[0] & 0x1f;
+    else if ((s[0] & 0xf0) == 0xe0)
+        len = 3, c = s[0] & 0x0f;
+    else if ((s[0] & 0xf8) == 0xf0)
+        len = 4, c = s[0] & 0x07;
+    else
+        return -1;
+    if ((unsigned int)inlen < len)
+        return -1;
+    for (i = 1; i < len; ++i) {
+        if ((s[i] & 0xc0) != 0x80)
+            return -1;
+        c = (c << 6) | (s[i] & 0x3f);
+    }
+    *pu = c;
+    return len;
+}
+
+/* Tracepoints, see ledmsg_trace.h */
+static inline void trace_ledmsg_frame_commit(unsigned int panel, unsigned int seq, bool overwritten) {
+    (void)panel; (void)seq; (void)overwritten;
+}
+
+struct device;
+struct task_struct;
+
+#endif /* LEDMSG_COMPAT_H */
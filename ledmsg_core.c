@@ -0,0 +1,1337 @@
+/**
+ * @file   ledmsg_core.c
+ * @author David Good
+ * @date   16 October 2026
+ * @version 0.1
+ * @brief  The scan engine of the ledmsgchar LKM, see ledmsg_core.h.
+ * Everything in here is plain C on top of the kernel APIs listed in
+ * ledmsg_compat.h, so it builds unchanged into the userspace simulator.
+ */
+
+#ifdef __KERNEL__
+#include <linux/slab.h>           // Required for the kmalloc() family
+#include <linux/mm.h>             // Required for alloc_pages_exact() of the frame buffers
+#include <linux/math64.h>         // Required for the 64 bit divisions of the scan timing
+#include <linux/nls.h>            // Required for utf8_to_utf32() in text mode
+#include <linux/string.h>         // Required for memcpy() and memset()
+#include <asm/unaligned.h>        // Required for the word loads and stores of the hex decoder
+#endif
+#include "ledmsg_core.h"
+#ifdef __KERNEL__
+#include "ledmsg_trace.h"         // Tracepoints, created in ledmsgchar_main.c
+#endif
+
+#define INIT_BUFFER_PATTERN {                                           \
+        {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,          \
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  \
+        {0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,          \
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  \
+        {0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,          \
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  \
+        {0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,          \
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  \
+        {0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,          \
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  \
+        {0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,          \
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  \
+        {0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,          \
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  \
+        {0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,          \
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}   \
+    }
+
+static const u8 initPattern[LEDMSG_NUM_ROWS][LEDMSG_NUM_ROW_BYTES] = INIT_BUFFER_PATTERN;
+
+/* Text mode font: 5x7 glyphs for the printable ASCII range, each stored as
+ * five columns with the top pixel in bit 0. The last entry is drawn for
+ * anything the font does not cover. ledmsg_build_glyph_cache() turns these into
+ * the row layout once at load time so drawing a glyph is a shift and an OR
+ * per row. */
+#define FONT_FIRST  0x20                ///< First character in fontColumns
+#define FONT_GLYPHS 96                  ///< Glyphs in fontColumns, 0x20-0x7E and the box
+static const u8 fontColumns[FONT_GLYPHS][LEDMSG_FONT_WIDTH] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00},  // ' ' '!'
+    {0x00, 0x07, 0x00, 0x07, 0x00}, {0x14, 0x7F, 0x14, 0x7F, 0x14},  // '"' '#'
+    {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},  // '$' '%'
+    {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00},  // '&' '\''
+    {0x00, 0x1C, 0x22, 0x41, 0x00}, {0x00, 0x41, 0x22, 0x1C, 0x00},  // '(' ')'
+    {0x14, 0x08, 0x3E, 0x08, 0x14}, {0x08, 0x08, 0x3E, 0x08, 0x08},  // '*' '+'
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08},  // ',' '-'
+    {0x00, 0x60, 0x60, 0x00, 0x00}, {0x20, 0x10, 0x08, 0x04, 0x02},  // '.' '/'
+    {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00},  // '0' '1'
+    {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31},  // '2' '3'
+    {0x18, 0x14, 0x12, 0x7F, 0x10}, {0x27, 0x45, 0x45, 0x45, 0x39},  // '4' '5'
+    {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},  // '6' '7'
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E},  // '8' '9'
+    {0x00, 0x36, 0x36, 0x00, 0x00}, {0x00, 0x56, 0x36, 0x00, 0x00},  // ':' ';'
+    {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14},  // '<' '='
+    {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06},  // '>' '?'
+    {0x32, 0x49, 0x79, 0x41, 0x3E}, {0x7E, 0x11, 0x11, 0x11, 0x7E},  // '@' 'A'
+    {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},  // 'B' 'C'
+    {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41},  // 'D' 'E'
+    {0x7F, 0x09, 0x09, 0x09, 0x01}, {0x3E, 0x41, 0x49, 0x49, 0x7A},  // 'F' 'G'
+    {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00},  // 'H' 'I'
+    {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41},  // 'J' 'K'
+    {0x7F, 0x40, 0x40, 0x40, 0x40}, {0x7F, 0x02, 0x0C, 0x02, 0x7F},  // 'L' 'M'
+    {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},  // 'N' 'O'
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E},  // 'P' 'Q'
+    {0x7F, 0x09, 0x19, 0x29, 0x46}, {0x46, 0x49, 0x49, 0x49, 0x31},  // 'R' 'S'
+    {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F},  // 'T' 'U'
+    {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F},  // 'V' 'W'
+    {0x63, 0x14, 0x08, 0x14, 0x63}, {0x07, 0x08, 0x70, 0x08, 0x07},  // 'X' 'Y'
+    {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00},  // 'Z' '['
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00},  // '\\' ']'
+    {0x04, 0x02, 0x01, 0x02, 0x04}, {0x40, 0x40, 0x40, 0x40, 0x40},  // '^' '_'
+    {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78},  // '`' 'a'
+    {0x7F, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20},  // 'b' 'c'
+    {0x38, 0x44, 0x44, 0x48, 0x7F}, {0x38, 0x54, 0x54, 0x54, 0x18},  // 'd' 'e'
+    {0x08, 0x7E, 0x09, 0x01, 0x02}, {0x0C, 0x52, 0x52, 0x52, 0x3E},  // 'f' 'g'
+    {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00},  // 'h' 'i'
+    {0x20, 0x40, 0x44, 0x3D, 0x00}, {0x7F, 0x10, 0x28, 0x44, 0x00},  // 'j' 'k'
+    {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x18, 0x04, 0x78},  // 'l' 'm'
+    {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38},  // 'n' 'o'
+    {0x7C, 0x14, 0x14, 0x14, 0x08}, {0x08, 0x14, 0x14, 0x18, 0x7C},  // 'p' 'q'
+    {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},  // 'r' 's'
+    {0x04, 0x3F, 0x44, 0x40, 0x20}, {0x3C, 0x40, 0x40, 0x20, 0x7C},  // 't' 'u'
+    {0x1C, 0x20, 0x40, 0x20, 0x1C}, {0x3C, 0x40, 0x30, 0x40, 0x3C},  // 'v' 'w'
+    {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0C, 0x50, 0x50, 0x50, 0x3C},  // 'x' 'y'
+    {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00},  // 'z' '{'
+    {0x00, 0x00, 0x7F, 0x00, 0x00}, {0x00, 0x41, 0x36, 0x08, 0x00},  // '|' '}'
+    {0x10, 0x08, 0x08, 0x10, 0x08}, {0x7F, 0x41, 0x41, 0x41, 0x7F},  // '~' box
+};
+static u8 glyphRows[FONT_GLYPHS][LEDMSG_FONT_HEIGHT]; ///< fontColumns transposed, MSB is the leftmost pixel
+
+/** @brief Transposes fontColumns into glyphRows, called once at load time */
+void ledmsg_build_glyph_cache(void) {
+    unsigned int g, r, c;
+
+    for (g = 0; g < FONT_GLYPHS; ++g)
+        for (r = 0; r < LEDMSG_FONT_HEIGHT; ++r) {
+            glyphRows[g][r] = 0;
+            for (c = 0; c < LEDMSG_FONT_WIDTH; ++c)
+                if (fontColumns[g][c] & (1 << r))
+                    glyphRows[g][r] |= 0x80 >> c;
+        }
+}
+
+/** @brief Looks a character up in the font, e.g. to check what ledmsg_render_text() drew
+ *  @param c A character code
+ *  @return LEDMSG_FONT_WIDTH columns, bit r set for each lit pixel of row r;
+ *  the box for characters the font does not cover
+ */
+const u8 *ledmsg_font_columns(u32 c) {
+    if (c < FONT_FIRST || c >= FONT_FIRST + FONT_GLYPHS - 1)
+        return fontColumns[FONT_GLYPHS - 1];
+    return fontColumns[c - FONT_FIRST];
+}
+
+/** @brief Compiles a row into one data line level per clock
+ *  Data is written Lowest byte first, Highest bit first so that the
+ *  buffer in memory reads left to right just like the sign.
+ *
+ *  @param bus The bus the row is for
+ *  @param rowData A pointer to bus->rowBytes bytes of pixels
+ *  @param stream Where to put the bus->rowBits levels, each 0 or 1
+ */
+void ledmsg_compile_levels(const struct ledmsg_bus *bus, const u8 *rowData, u8 *stream) {
+    unsigned int numBytes = bus->rowBytes;
+    unsigned char mask;
+    unsigned char b;
+    while (numBytes > 0) {
+        b = *rowData;
+        ++rowData;
+        for (mask = 0x80; mask != 0; mask >>= 1)
+            *stream++ = (b & mask) ? 1 : 0;
+        --numBytes;
+    }
+}
+
+/** @brief Internal: Reads a panel row's worth of pixels from a canvas row
+ *  The read wraps around the right edge of the canvas.
+ *
+ *  @param bus The bus giving the sizes
+ *  @param canvasRow A pointer to bus->canvasRowBytes bytes of pixels
+ *  @param x Canvas column of the first pixel
+ *  @param rowData Where to put the bus->rowBytes bytes
+ */
+static void extract_row(const struct ledmsg_bus *bus, const u8 *canvasRow, unsigned int x, u8 *rowData) {
+    unsigned int shift = x & 7;
+    unsigned int index = x >> 3;
+    unsigned int next, i;
+
+    for (i = 0; i < bus->rowBytes; ++i) {
+        next = (index + 1 == bus->canvasRowBytes) ? 0 : index + 1;
+        rowData[i] = shift ? (canvasRow[index] << shift) | (canvasRow[next] >> (8 - shift))
+                           : canvasRow[index];
+        index = next;
+    }
+}
+
+/** @brief Internal: Compiles one panel row of a frame as seen through a viewport
+ *  @param panel The panel the frame belongs to
+ *  @param frame The frame to compile
+ *  @param plane Bit-plane of the row
+ *  @param row Panel row
+ *  @param x Canvas column shown at the left of the panel
+ *  @param y Canvas row shown at the top of the panel
+ */
+static void compile_row(struct ledmsg_panel *panel, struct ledmsg_frame *frame, unsigned int plane,
+                        unsigned int row, unsigned int x, unsigned int y) {
+    const struct ledmsg_bus *bus = panel->bus;
+    unsigned int canvasRow = (y + row) % bus->canvasHeight;
+    u8 rowData[LEDMSG_MAX_ROW_BYTES];
+    u8 lit = 0;
+    unsigned int i;
+
+    extract_row(bus, frame->composed + plane * bus->canvasBytes + canvasRow * bus->canvasRowBytes, x, rowData);
+    bus->output->compile_row(bus, rowData, frame->stream + (plane * bus->numRows + row) * bus->streamSize);
+    for (i = 0; i < bus->rowBytes; ++i)
+        lit |= rowData[i];
+    if (lit)
+        frame->blankRows[plane] &= ~BIT(row);
+    else
+        frame->blankRows[plane] |= BIT(row);
+}
+
+/** @brief Internal: Compiles every row of a frame as seen through a viewport
+ *  Called when a frame is committed, and by update_row when the viewport moves.
+ *  @param panel The panel the frame belongs to
+ *  @param frame The frame to compile
+ *  @param x Canvas column shown at the left of the panel
+ *  @param y Canvas row shown at the top of the panel
+ */
+static void compile_frame(struct ledmsg_panel *panel, struct ledmsg_frame *frame, unsigned int x, unsigned int y) {
+    unsigned int p, r;
+
+    for (p = 0; p < frame->numPlanes; ++p)
+        for (r = 0; r < panel->bus->numRows; ++r)
+            compile_row(panel, frame, p, r, x, y);
+    frame->viewX = x;
+    frame->viewY = y;
+    frame->compiledPlanes = frame->numPlanes;
+    frame->dirtyRows = 0;
+    frame->compileSeq = atomic_inc_return(&panel->compileSeq);
+}
+
+/** @brief Internal: ORs a run of bytes into another, a word at a time
+ *  @param dst The bytes to OR into
+ *  @param src The bytes to OR in
+ *  @param len Bytes in the run
+ */
+static void or_span(u8 *dst, const u8 *src, size_t len) {
+    for (; len >= sizeof(unsigned long); len -= sizeof(unsigned long)) {
+        put_unaligned(get_unaligned((unsigned long *)dst) | get_unaligned((const unsigned long *)src),
+                      (unsigned long *)dst);
+        dst += sizeof(unsigned long);
+        src += sizeof(unsigned long);
+    }
+    for (; len; --len)
+        *dst++ |= *src++;
+}
+
+/** @brief Internal: Replaces the bits of a run of bytes that a mask covers, a word at a time
+ *  @param dst The bytes to change
+ *  @param src The bits to put in
+ *  @param cover Set for the bits of dst to take from src
+ *  @param len Bytes in the run
+ */
+static void blend_span(u8 *dst, const u8 *src, const u8 *cover, size_t len) {
+    unsigned long m;
+
+    for (; len >= sizeof(unsigned long); len -= sizeof(unsigned long)) {
+        m = get_unaligned((const unsigned long *)cover);
+        put_unaligned((get_unaligned((unsigned long *)dst) & ~m) | (get_unaligned((const unsigned long *)src) & m),
+                      (unsigned long *)dst);
+        dst += sizeof(unsigned long);
+        src += sizeof(unsigned long);
+        cover += sizeof(unsigned long);
+    }
+    for (; len; --len, ++dst, ++src, ++cover)
+        *dst = (*dst & ~*cover) | (*src & *cover);
+}
+
+/** @brief Internal: Draws one canvas row of a layer over the layered planes of a frame
+ *  Plane p of the frame takes the layer's plane of the same weight. A layer
+ *  with fewer planes repeats its bits downwards, so a binary layer is full on.
+ *
+ *  @param panel The panel, its coverRow is used as scratch space
+ *  @param frame The frame, whose layered planes hold this row of what is below
+ *  @param layer The layer
+ *  @param row Canvas row
+ */
+static void composite_layer_row(struct ledmsg_panel *panel, struct ledmsg_frame *frame,
+                                const struct ledmsg_panel_layer *layer, unsigned int row) {
+    const struct ledmsg_bus *bus = panel->bus;
+    size_t rowBytes = bus->canvasRowBytes;
+    size_t src = ((row + bus->canvasHeight - layer->y) % bus->canvasHeight) * rowBytes;
+    size_t dst = row * rowBytes;
+    size_t split = rowBytes - layer->x / 8;     // Layer bytes before the right edge of the canvas
+    int lp = layer->frame.numPlanes, np = frame->numPlanes;
+    const u8 *from;
+    u8 *to;
+    int p, q;
+
+    if (layer->mask) {
+        memcpy(panel->coverRow, layer->mask + src, rowBytes);
+    } else if (layer->flags & LEDMSG_LAYER_OPAQUE) {
+        memset(panel->coverRow, 0xff, rowBytes);
+    } else {
+        memcpy(panel->coverRow, layer->frame.data + src, rowBytes);
+        for (q = 1; q < lp; ++q)
+            or_span(panel->coverRow, layer->frame.data + q * bus->canvasBytes + src, rowBytes);
+    }
+    for (p = 0; p < np; ++p) {
+        q = ((p + lp - np) % lp + lp) % lp;
+        from = layer->frame.data + q * bus->canvasBytes + src;
+        to = frame->layered + p * bus->canvasBytes + dst;
+        blend_span(to + rowBytes - split, from, panel->coverRow, split);
+        blend_span(to, from + split, panel->coverRow + split, rowBytes - split);
+    }
+}
+
+/** @brief Internal: Brings the planes a frame is compiled from up to date for its dirty rows
+ *  Without layers that is the frame's own data. With layers the dirty rows of
+ *  data are copied to the layered planes and every layer drawn over them.
+ *  When the frame switches between the two all its rows are made dirty.
+ *
+ *  @param panel The panel the frame belongs to
+ *  @param frame The frame, its dirtyRows say which rows changed
+ */
+static void composite_rows(struct ledmsg_panel *panel, struct ledmsg_frame *frame) {
+    const struct ledmsg_bus *bus = panel->bus;
+    const struct ledmsg_panel_layer *layer;
+    u8 *composed = (frame->layered && !list_empty(&panel->layers)) ? frame->layered : frame->data;
+    unsigned int p, r;
+    size_t offset;
+
+    if (frame->composed != composed) {
+        frame->composed = composed;
+        frame->dirtyRows = LEDMSG_ALL_ROWS;
+    }
+    if (composed == frame->data)
+        return;
+    for (r = 0; r < bus->canvasHeight; ++r) {
+        if (!(frame->dirtyRows & BIT_ULL(r)))
+            continue;
+        offset = r * bus->canvasRowBytes;
+        for (p = 0; p < frame->numPlanes; ++p, offset += bus->canvasBytes)
+            memcpy(frame->layered + offset, frame->data + offset, bus->canvasRowBytes);
+        list_for_each_entry(layer, &panel->layers, node)
+            if (!(layer->flags & LEDMSG_LAYER_HIDDEN))
+                composite_layer_row(panel, frame, layer, r);
+    }
+}
+
+/** @brief Compiles a frame being committed for the viewport update_row shows now
+ *  The layers of the panel are drawn over it first, if it has room for them.
+ *  @param panel The panel the frame belongs to
+ *  @param frame The frame to compile
+ */
+void ledmsg_commit_frame(struct ledmsg_panel *panel, struct ledmsg_frame *frame) {
+    frame->dirtyRows = LEDMSG_ALL_ROWS;
+    composite_rows(panel, frame);
+    compile_frame(panel, frame, READ_ONCE(panel->viewX), READ_ONCE(panel->viewY));
+}
+
+/** @brief Compiles only the panel rows showing frame->dirtyRows
+ *  A small update costs a few rows instead of the whole frame. Falls back to
+ *  ledmsg_commit_frame() when the viewport moved or the number of bit-planes
+ *  changed since the frame was last compiled.
+ *
+ *  @param panel The panel the frame belongs to
+ *  @param frame The frame to compile, the rest of its rows must be compiled already
+ */
+void ledmsg_commit_rows(struct ledmsg_panel *panel, struct ledmsg_frame *frame) {
+    const struct ledmsg_bus *bus = panel->bus;
+    unsigned int x = READ_ONCE(panel->viewX);
+    unsigned int y = READ_ONCE(panel->viewY);
+    unsigned int p, r;
+
+    composite_rows(panel, frame);
+    if (x != frame->viewX || y != frame->viewY || frame->compiledPlanes != frame->numPlanes) {
+        compile_frame(panel, frame, x, y);
+        return;
+    }
+    if (!frame->dirtyRows)
+        return;
+    for (r = 0; r < bus->numRows; ++r) {
+        if (!(frame->dirtyRows & BIT_ULL((y + r) % bus->canvasHeight)))
+            continue;
+        for (p = 0; p < frame->numPlanes; ++p)
+            compile_row(panel, frame, p, r, x, y);
+    }
+    frame->dirtyRows = 0;
+    frame->compileSeq = atomic_inc_return(&panel->compileSeq);
+}
+
+/* Hex decoding, eight characters to four bytes per step. Each step loads the
+ * characters as one little endian word and works on all eight lanes at once
+ * (SWAR). For lanes under 0x80, adding 0x80 - lo sets a lane's top bit
+ * exactly when it is >= lo, and adding 0x7f - hi when it is > hi, without
+ * carrying into the next lane. */
+#define HEX_LANES(b)    (0x0101010101010101ULL * (b))   ///< b in every byte lane of a word
+
+/** @brief Internal: Value of one hex digit
+ *  @param c An ASCII character
+ *  @return 0-15, or -1 if c is not a hex digit
+ */
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;                          // Fold upper case onto lower case
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+/** @brief Internal: Decodes eight hex characters into four bytes
+ *  @param hex The characters, need not be aligned
+ *  @param data Where to put the four bytes, need not be aligned
+ *  @return The top bit of each lane that is not a hex digit, so 0 if all eight
+ *  were; data is written either way
+ */
+static u64 decode_hex_word(const char *hex, u8 *data) {
+    u64 w = get_unaligned_le64(hex);
+    u64 l, digit, alpha, nibbles;
+
+    // A lane is a digit if it is in '0'-'9', a letter if folded to lower case it is in 'a'-'f'
+    digit = (w + HEX_LANES(0x80 - '0')) & ~(w + HEX_LANES(0x7f - '9'));
+    l = w | HEX_LANES(0x20);
+    alpha = (l + HEX_LANES(0x80 - 'a')) & ~(l + HEX_LANES(0x7f - 'f'));
+
+    // The low nibble of a digit is its value, that of a letter is its value - 9
+    nibbles = (w & HEX_LANES(0x0f)) + ((alpha & HEX_LANES(0x80)) >> 7) * 9;
+
+    // The first character of each pair is the high nibble, then squeeze the pairs together
+    nibbles = ((nibbles & 0x00ff00ff00ff00ffULL) << 4) | ((nibbles >> 8) & 0x00ff00ff00ff00ffULL);
+    nibbles = (nibbles | (nibbles >> 8)) & 0x0000ffff0000ffffULL;
+    nibbles = (nibbles | (nibbles >> 16)) & 0xffffffffULL;
+    put_unaligned_le32((u32)nibbles, data);
+
+    return (w | ~(digit | alpha)) & HEX_LANES(0x80);
+}
+
+/** @brief Decodes a hex frame, two ASCII characters per byte, upper or lower case
+ *  @param hex numBytes * 2 characters
+ *  @param data Where to put the numBytes bytes
+ *  @param numBytes Bytes to decode
+ *  @return 0 if successful, -EINVAL if a character is not a hex digit, in
+ *  which case data holds garbage
+ */
+int ledmsg_decode_hex(const char *hex, u8 *data, size_t numBytes) {
+    u64 invalid = 0;
+    int hi, lo;
+
+    for (; numBytes >= 4; numBytes -= 4, hex += 8, data += 4)
+        invalid |= decode_hex_word(hex, data);
+    for (; numBytes; --numBytes, hex += 2) {
+        hi = hex_digit(hex[0]);
+        lo = hex_digit(hex[1]);
+        invalid |= (hi | lo) < 0;
+        *data++ = (hi << 4) | (lo & 0xf);
+    }
+    return invalid ? -EINVAL : 0;
+}
+
+/** @brief Encodes bytes as hex, two lower case ASCII characters per byte
+ *  @param data numBytes bytes
+ *  @param hex Where to put the numBytes * 2 characters, not null terminated
+ *  @param numBytes Bytes to encode
+ */
+void ledmsg_encode_hex(const u8 *data, char *hex, size_t numBytes) {
+    static const char digits[] = "0123456789abcdef";
+    size_t index;
+
+    for (index = 0; index < numBytes; ++index) {
+        *hex++ = digits[data[index] >> 4];
+        *hex++ = digits[data[index] & 0xf];
+    }
+}
+
+/** @brief Splits one byte per pixel into bit-planes, least significant plane first
+ *  Only the top numPlanes bits of each pixel are kept.
+ *
+ *  @param bus The bus giving the canvas size
+ *  @param pixels numBytes * 8 pixels in [row][column] order
+ *  @param numPlanes Number of planes to generate
+ *  @param planes Where to put the first byte of plane 0, the planes are canvasBytes apart
+ *  @param numBytes Bytes of each plane to generate, canvasBytes for a whole canvas
+ */
+void ledmsg_gray_to_planes(const struct ledmsg_bus *bus, const u8 *pixels, unsigned int numPlanes,
+                           u8 *planes, size_t numBytes) {
+    unsigned int p, bit, shift;
+    size_t i;
+    u8 b;
+
+    for (p = 0; p < numPlanes; ++p, planes += bus->canvasBytes) {
+        shift = 8 - numPlanes + p;
+        for (i = 0; i < numBytes; ++i) {
+            b = 0;
+            for (bit = 0; bit < 8; ++bit)
+                b = (b << 1) | ((pixels[i * 8 + bit] >> shift) & 1);
+            planes[i] = b;
+        }
+    }
+}
+
+/** @brief Joins the bit-planes of a frame into one byte per pixel, the inverse of ledmsg_gray_to_planes()
+ *  Levels are scaled to 0-255, so a binary frame comes out as 0 and 255.
+ *  @param bus The bus giving the canvas size
+ *  @param planes numPlanes canvas sized bit-planes, like ledmsg_frame.data
+ *  @param numPlanes Number of bit-planes
+ *  @param pixels Where to put canvasBytes * 8 pixels in [row][column] order
+ */
+void ledmsg_planes_to_gray(const struct ledmsg_bus *bus, const u8 *planes, unsigned int numPlanes, u8 *pixels) {
+    unsigned int levels = (1U << numPlanes) - 1;
+    unsigned int p, v, bit;
+    size_t i;
+
+    for (i = 0; i < bus->canvasBytes * 8; ++i) {
+        v = 0;
+        bit = 0x80 >> (i & 7);
+        for (p = 0; p < numPlanes; ++p)
+            if (planes[p * bus->canvasBytes + i / 8] & bit)
+                v |= 1U << p;
+        pixels[i] = v * 255 / levels;
+    }
+}
+
+/** @brief Internal: Changes the number of bit-planes of a frame, keeping its levels
+ *  A binary frame comes out full on and a gray one keeps the top bits it has room for.
+ *
+ *  @param panel The panel, its grayBuf is used as scratch space
+ *  @param frame The frame, not compiled
+ *  @param numPlanes New number of bit-planes
+ */
+static void replane_frame(struct ledmsg_panel *panel, struct ledmsg_frame *frame, unsigned int numPlanes) {
+    ledmsg_planes_to_gray(panel->bus, frame->data, frame->numPlanes, panel->grayBuf);
+    ledmsg_gray_to_planes(panel->bus, panel->grayBuf, numPlanes, frame->data, panel->bus->canvasBytes);
+    frame->numPlanes = numPlanes;
+    frame->dirtyRows = LEDMSG_ALL_ROWS;
+}
+
+/** @brief Internal: Decodes the next character of a UTF-8 string
+ *  A malformed sequence is taken one byte at a time so the rest still shows.
+ *
+ *  @param text The string
+ *  @param len Bytes left in it, at least one
+ *  @param used Set to the number of bytes consumed
+ *  @return The glyphRows entry for the character
+ */
+static const u8 *next_glyph(const u8 *text, size_t len, int *used) {
+    unicode_t c;
+
+    *used = utf8_to_utf32(text, len, &c);
+    if (*used <= 0) {
+        *used = 1;
+        c = 0;
+    }
+    if (c < FONT_FIRST || c >= FONT_FIRST + FONT_GLYPHS - 1)
+        return glyphRows[FONT_GLYPHS - 1];
+    return glyphRows[c - FONT_FIRST];
+}
+
+/** @brief Internal: Draws a glyph into a canvas plane, clipping at the edges
+ *  @param bus The bus giving the canvas size
+ *  @param plane bus->canvasBytes of pixels
+ *  @param glyph LEDMSG_FONT_HEIGHT rows from glyphRows
+ *  @param x Canvas column of the glyph's left edge
+ *  @param y Canvas row of the glyph's top edge
+ *  @param invert Clear the glyph's pixels instead of setting them
+ */
+static void draw_glyph(const struct ledmsg_bus *bus, u8 *plane, const u8 *glyph, int x, int y, bool invert) {
+    unsigned int index;
+    u8 *dst;
+    u16 bits;
+    int r;
+
+    if (x <= -8 || x >= (int)bus->canvasWidth)
+        return;
+    for (r = 0; r < LEDMSG_FONT_HEIGHT; ++r) {
+        if (y + r < 0 || y + r >= (int)bus->canvasHeight || !glyph[r])
+            continue;
+        // Line the row up on a byte boundary, the glyph spills into the low byte
+        bits = (x < 0) ? (u8)(glyph[r] << -x) << 8 : glyph[r] << (8 - (x & 7));
+        index = (x < 0) ? 0 : x >> 3;
+        dst = plane + (y + r) * bus->canvasRowBytes + index;
+        if (invert)
+            dst[0] &= ~(u8)(bits >> 8);
+        else
+            dst[0] |= (u8)(bits >> 8);
+        if (!(bits & 0xff) || index + 1 >= bus->canvasRowBytes)
+            continue;
+        if (invert)
+            dst[1] &= ~(u8)bits;
+        else
+            dst[1] |= (u8)bits;
+    }
+}
+
+/** @brief Internal: Counts the characters up to the end of a line of text
+ *  @param text The start of the line
+ *  @param len Bytes left in the text
+ *  @return The number of characters before the next newline or the end
+ */
+static unsigned int line_chars(const u8 *text, size_t len) {
+    unsigned int count = 0;
+    int used;
+
+    while (len && *text != '\n') {
+        next_glyph(text, len, &used);
+        text += used;
+        len -= used;
+        ++count;
+    }
+    return count;
+}
+
+/** @brief Draws text into a frame, replacing all of it
+ *  The frame is not compiled.
+ *
+ *  @param bus The bus giving the canvas size
+ *  @param attr How to draw the text
+ *  @param text len bytes of UTF-8
+ *  @param len Bytes of text
+ *  @param frame The frame to draw into
+ */
+void ledmsg_render_text(const struct ledmsg_bus *bus, const struct ledmsg_text *attr,
+                        const u8 *text, size_t len, struct ledmsg_frame *frame) {
+    bool invert = attr->flags & LEDMSG_TEXT_INVERT;
+    const u8 *glyph;
+    int x, y = attr->y;
+    bool lineStart = true;
+    int used;
+
+    frame->numPlanes = 1;
+    memset(frame->data, invert ? 0xff : 0x00, bus->canvasBytes);
+
+    while (len) {
+        if (lineStart) {
+            x = attr->x;
+            if (attr->flags & LEDMSG_TEXT_CENTER)
+                x += ((int)bus->canvasWidth - (int)line_chars(text, len) * LEDMSG_FONT_ADVANCE + 1) / 2;
+            lineStart = false;
+        }
+        if (*text == '\n') {
+            y += LEDMSG_FONT_HEIGHT;
+            lineStart = true;
+            ++text;
+            --len;
+            continue;
+        }
+        glyph = next_glyph(text, len, &used);
+        draw_glyph(bus, frame->data, glyph, x, y, invert);
+        x += LEDMSG_FONT_ADVANCE;
+        text += used;
+        len -= used;
+    }
+}
+
+/** @brief Tells whether a published frame is still waiting for update_row
+ *  @param panel The panel
+ *  @return true if the pending buffer has not been shown yet
+ */
+bool ledmsg_frame_pending(struct ledmsg_panel *panel) {
+    return atomic_read(&panel->pending) & FRAME_DIRTY;
+}
+
+/** @brief Gets the back buffer ready to have part of it rewritten
+ *  The back buffer holds an older frame, so the rows that changed since are
+ *  copied over from the newest one first; that is usually a handful of rows,
+ *  not the whole frame. The caller then rewrites some rows, adds them to the
+ *  frame's dirtyRows and hands it on with ledmsg_commit_rows() and
+ *  ledmsg_publish_rows(). Must be called with writeLock held.
+ *
+ *  @param panel The panel
+ *  @param numPlanes Bit-planes the new frame is to have, 0 to keep those of the newest frame
+ *  @return The back buffer, holding the newest frame
+ */
+struct ledmsg_frame *ledmsg_edit_back(struct ledmsg_panel *panel, unsigned int numPlanes) {
+    const struct ledmsg_bus *bus = panel->bus;
+    struct ledmsg_frame *back = &panel->frames[panel->back];
+    const struct ledmsg_frame *latest = &panel->frames[panel->latest];
+    u64 stale = back->staleRows;
+    unsigned int p, r;
+    size_t offset;
+
+    if (back->numPlanes != latest->numPlanes)
+        stale = LEDMSG_ALL_ROWS;
+    if (stale == LEDMSG_ALL_ROWS) {
+        memcpy(back->data, latest->data, latest->numPlanes * bus->canvasBytes);
+    } else {
+        for (r = 0; r < bus->canvasHeight; ++r) {
+            if (!(stale & BIT_ULL(r)))
+                continue;
+            offset = r * bus->canvasRowBytes;
+            for (p = 0; p < latest->numPlanes; ++p, offset += bus->canvasBytes)
+                memcpy(back->data + offset, latest->data + offset, bus->canvasRowBytes);
+        }
+    }
+    back->numPlanes = latest->numPlanes;
+    back->staleRows = 0;
+    back->dirtyRows |= stale;
+    if (numPlanes && numPlanes != back->numPlanes)
+        replane_frame(panel, back, numPlanes);
+    return back;
+}
+
+/** @brief Hands the back buffer to update_row and takes the pending one in exchange
+ *  The back buffer must already be compiled. The exchange is a full barrier, so the frame contents are visible to update_row
+ *  before it can see FRAME_DIRTY. Must be called with writeLock held.
+ *  @param panel The panel
+ */
+void ledmsg_publish_back(struct ledmsg_panel *panel) {
+    ledmsg_publish_rows(panel, LEDMSG_ALL_ROWS);
+}
+
+/** @brief Hands the back buffer to update_row after only some of its rows changed
+ *  Like ledmsg_publish_back(), and marks the rows stale in the other buffers
+ *  so ledmsg_edit_back() knows what to bring over. Must be called with writeLock held.
+ *  @param panel The panel
+ *  @param rows Canvas rows that differ from the frame published before
+ */
+void ledmsg_publish_rows(struct ledmsg_panel *panel, u64 rows) {
+    unsigned int seq = panel->frames[panel->back].compileSeq;
+    unsigned int old, i;
+
+    for (i = 0; i < NUM_FRAMES; ++i)
+        panel->frames[i].staleRows |= rows;
+    panel->frames[panel->back].staleRows = 0;
+    panel->frames[panel->back].seq = ++panel->frameSeq;
+    panel->latest = panel->back;
+
+    old = atomic_xchg(&panel->pending, panel->back | FRAME_DIRTY);
+    panel->back = old & FRAME_INDEX_MASK;
+    ++panel->stats.committed;
+    if (old & FRAME_DIRTY)
+        ++panel->stats.overwritten;
+    trace_ledmsg_frame_commit(panel->index, seq, old & FRAME_DIRTY);
+}
+
+/** @brief Internal: Puts the playing playlist on retiredPlaylists, under playlistLock
+ *  @param panel The panel whose playlist to retire
+ */
+static void retire_playlist(struct ledmsg_panel *panel) {
+    if (panel->playlist)
+        list_add_tail(&panel->playlist->node, &panel->retiredPlaylists);
+    panel->playlist = NULL;
+    // Writers may free it from now on, so ledmsg_shown_frame() must not find it
+    WRITE_ONCE(panel->shown, &panel->frames[panel->front]);
+}
+
+/** @brief The frame update_row shows, for taking a snapshot of it
+ *  Must be called with writeLock held, and the frame only used while it is:
+ *  writers then cannot change a published frame buffer or free the playlist
+ *  the frame may belong to, so it holds still however update_row moves on.
+ *  @param panel The panel
+ *  @return The frame, or the front buffer if update_row has not started yet
+ */
+const struct ledmsg_frame *ledmsg_shown_frame(struct ledmsg_panel *panel) {
+    const struct ledmsg_frame *frame;
+
+    spin_lock(&panel->playlistLock);
+    frame = READ_ONCE(panel->shown);
+    spin_unlock(&panel->playlistLock);
+    return frame ? frame : &panel->frames[READ_ONCE(panel->front)];
+}
+
+/** @brief Frees a playlist and the compiled rows of its frames
+ *  @param pl The playlist, may be NULL
+ */
+void ledmsg_free_playlist(struct ledmsg_playlist *pl) {
+    unsigned int i;
+
+    if (!pl)
+        return;
+    for (i = 0; i < pl->count; ++i)
+        kfree(pl->frames[i].stream);
+    kvfree(pl->data);
+    kvfree(pl->durationNs);
+    kfree(pl);
+}
+
+/** @brief Frees the playlists update_row is done with
+ *  @param panel The panel whose retired playlists to free
+ */
+void ledmsg_free_retired_playlists(struct ledmsg_panel *panel) {
+    struct ledmsg_playlist *pl;
+    LIST_HEAD(done);
+
+    spin_lock(&panel->playlistLock);
+    list_splice_init(&panel->retiredPlaylists, &done);
+    spin_unlock(&panel->playlistLock);
+    while (!list_empty(&done)) {
+        pl = list_first_entry(&done, struct ledmsg_playlist, node);
+        list_del(&pl->node);
+        ledmsg_free_playlist(pl);
+    }
+}
+
+/** @brief Allocates a blank layer, not yet placed on the panel
+ *  The first layer of a panel also allocates the layered planes its frames
+ *  are composited into and the draft layers are written in. Must be called
+ *  with writeLock held.
+ *
+ *  @param panel The panel the layer is for
+ *  @return The layer, or NULL if out of memory
+ */
+struct ledmsg_panel_layer *ledmsg_layer_alloc(struct ledmsg_panel *panel) {
+    const struct ledmsg_bus *bus = panel->bus;
+    struct ledmsg_panel_layer *layer;
+    int i;
+
+    if (!panel->layerBuf) {
+        panel->coverRow = kmalloc(bus->canvasRowBytes, GFP_KERNEL);
+        panel->layerBuf = kvmalloc(NUM_FRAMES * bus->frameStride, GFP_KERNEL);
+        panel->layerDraft.data = kvmalloc(LEDMSG_MAX_GRAY_BITS * bus->canvasBytes, GFP_KERNEL);
+        if (!panel->coverRow || !panel->layerBuf || !panel->layerDraft.data) {
+            kfree(panel->coverRow);
+            kvfree(panel->layerBuf);
+            kvfree(panel->layerDraft.data);
+            panel->coverRow = NULL;
+            panel->layerBuf = NULL;
+            panel->layerDraft.data = NULL;
+            return NULL;
+        }
+        for (i = 0; i < NUM_FRAMES; ++i)
+            panel->frames[i].layered = panel->layerBuf + i * bus->frameStride;
+    }
+    layer = kzalloc(sizeof *layer, GFP_KERNEL);
+    if (!layer)
+        return NULL;
+    layer->frame.data = kvzalloc(LEDMSG_MAX_GRAY_BITS * bus->canvasBytes, GFP_KERNEL);
+    if (!layer->frame.data) {
+        kfree(layer);
+        return NULL;
+    }
+    layer->frame.numPlanes = 1;
+    INIT_LIST_HEAD(&layer->node);
+    return layer;
+}
+
+/** @brief Takes a layer off its panel and frees it
+ *  The rows it covered still show it until they are composited again. Must
+ *  be called with writeLock held.
+ *  @param layer The layer, may be NULL
+ */
+void ledmsg_layer_free(struct ledmsg_panel_layer *layer) {
+    if (!layer)
+        return;
+    list_del(&layer->node);
+    kvfree(layer->frame.data);
+    kvfree(layer->mask);
+    kfree(layer);
+}
+
+/** @brief Puts a layer in the stack of its panel, or moves it after its z changed
+ *  It goes on top of the layers with the same z. Must be called with writeLock held.
+ *  @param panel The panel
+ *  @param layer The layer
+ */
+void ledmsg_layer_place(struct ledmsg_panel *panel, struct ledmsg_panel_layer *layer) {
+    struct ledmsg_panel_layer *pos;
+
+    list_del(&layer->node);
+    list_for_each_entry(pos, &panel->layers, node)
+        if (pos->z > layer->z)
+            break;
+    list_add_tail(&layer->node, &pos->node);
+}
+
+/** @brief Gets a layer ready to be written, like ledmsg_edit_back() for the frame below
+ *  The write goes to a draft holding a copy of the layer, which only replaces
+ *  the layer in ledmsg_commit_layer(). A write that is rejected half way is
+ *  simply not committed, and the layer is composited as it was. Must be
+ *  called with writeLock held.
+ *
+ *  @param panel The panel the layer is on
+ *  @param layer The layer
+ *  @param numPlanes Bit-planes about to be written, 0 to keep what the layer has
+ *  @return The draft, whose data is to be written
+ */
+struct ledmsg_frame *ledmsg_edit_layer(struct ledmsg_panel *panel, struct ledmsg_panel_layer *layer,
+                                       unsigned int numPlanes) {
+    struct ledmsg_frame *draft = &panel->layerDraft;
+
+    memcpy(draft->data, layer->frame.data, layer->frame.numPlanes * panel->bus->canvasBytes);
+    draft->numPlanes = layer->frame.numPlanes;
+    if (numPlanes && numPlanes != draft->numPlanes)
+        replane_frame(panel, draft, numPlanes);
+    return draft;
+}
+
+/** @brief Makes the draft ledmsg_edit_layer() handed out the layer's pixels
+ *  The layers still have to be composited again to show it. Must be called
+ *  with writeLock held.
+ *  @param panel The panel the layer is on
+ *  @param layer The layer the draft was made from
+ */
+void ledmsg_commit_layer(struct ledmsg_panel *panel, struct ledmsg_panel_layer *layer) {
+    u8 *data = layer->frame.data;
+
+    layer->frame.data = panel->layerDraft.data;     // Both hold LEDMSG_MAX_GRAY_BITS planes
+    layer->frame.numPlanes = panel->layerDraft.numPlanes;
+    panel->layerDraft.data = data;
+}
+
+/** @brief Works out which canvas rows rows of a layer are shown on
+ *  @param bus The bus giving the canvas size
+ *  @param layer The layer
+ *  @param rows Bit r set for row r of the layer
+ *  @return Bit r set for canvas row r
+ */
+u64 ledmsg_layer_rows(const struct ledmsg_bus *bus, const struct ledmsg_panel_layer *layer, u64 rows) {
+    u64 shown = 0;
+    unsigned int r;
+
+    if (rows == LEDMSG_ALL_ROWS)
+        return rows;
+    for (r = 0; r < bus->canvasHeight; ++r)
+        if (rows & BIT_ULL(r))
+            shown |= BIT_ULL((r + layer->y) % bus->canvasHeight);
+    return shown;
+}
+
+/** @brief Internal: Wraps a coordinate into [0, size)
+ *  @param v The coordinate
+ *  @param size The canvas dimension
+ *  @return v modulo size, never negative
+ */
+static unsigned int wrap_coord(s64 v, u32 size) {
+    s32 rem;
+
+    div_s64_rem(v, size, &rem);
+    return rem < 0 ? rem + size : (u32)rem;
+}
+
+/** @brief Internal: Works out where a panel's viewport is at a frame boundary
+ *  Picks up a new LEDMSG_IOC_SET_VIEWPORT and advances a scrolling viewport
+ *  by the time elapsed since it was set, so the speed doesn't drift.
+ *
+ *  @param panel The panel
+ *  @param now The time of the frame boundary
+ */
+static void update_viewport(struct ledmsg_panel *panel, ktime_t now) {
+    s64 elapsedUs;
+    s64 x, y;
+
+    if (READ_ONCE(panel->viewGen) != panel->engineViewGen) {
+        spin_lock(&panel->viewLock);
+        panel->engineView = panel->requestedView;
+        panel->engineViewTime = panel->requestedViewTime;
+        panel->engineViewGen = panel->viewGen;
+        spin_unlock(&panel->viewLock);
+    }
+
+    x = panel->engineView.x;
+    y = panel->engineView.y;
+    if (panel->engineView.dxPerSec || panel->engineView.dyPerSec) {
+        elapsedUs = ktime_to_us(ktime_sub(now, panel->engineViewTime));
+        x += div_s64(elapsedUs * panel->engineView.dxPerSec, USEC_PER_SEC);
+        y += div_s64(elapsedUs * panel->engineView.dyPerSec, USEC_PER_SEC);
+    }
+    WRITE_ONCE(panel->viewX, wrap_coord(x, panel->bus->canvasWidth));
+    WRITE_ONCE(panel->viewY, wrap_coord(y, panel->bus->canvasHeight));
+}
+
+/** @brief Internal: Picks the frame a panel shows next, called at every frame boundary
+ *  A newly published frame wins over a playing playlist, a newly queued playlist
+ *  wins over both. Playlist frames move on when their display time is up, so
+ *  timing is kept to the frame boundary and doesn't drift.
+ *
+ *  @param panel The panel
+ *  @param now The time of the frame boundary
+ *  @return The frame to scan out until the next frame boundary
+ */
+static struct ledmsg_frame *frame_boundary(struct ledmsg_panel *panel, ktime_t now) {
+    struct ledmsg_playlist *pl;
+    bool published = false;
+
+    if (atomic_read(&panel->pending) & FRAME_DIRTY) {
+        panel->front = atomic_xchg(&panel->pending, panel->front) & FRAME_INDEX_MASK;
+        published = true;
+        ++panel->stats.shown;
+        wake_up_interruptible(&panel->frameWait);
+    }
+
+    if (READ_ONCE(panel->queuedPlaylist) || READ_ONCE(panel->stopPlaylist) || (published && panel->playlist)) {
+        spin_lock(&panel->playlistLock);
+        if (published || panel->stopPlaylist || panel->queuedPlaylist)
+            retire_playlist(panel);
+        if (panel->queuedPlaylist) {
+            panel->playlist = panel->queuedPlaylist;
+            panel->queuedPlaylist = NULL;
+            panel->playlistStarted = false;
+        }
+        panel->stopPlaylist = false;
+        spin_unlock(&panel->playlistLock);
+        wake_up_interruptible(&panel->frameWait);
+    }
+
+    pl = panel->playlist;
+    if (!pl)
+        return &panel->frames[panel->front];
+
+    if (!panel->playlistStarted) {
+        if (ktime_before(now, pl->start))
+            return &panel->frames[panel->front];
+        panel->playlistStarted = true;
+        panel->playlistEntry = 0;
+        panel->playlistEntryEnd = ktime_add_ns(now, pl->durationNs[0]);
+    } else if (!ktime_before(now, panel->playlistEntryEnd)) {
+        if (++panel->playlistEntry == pl->count) {
+            if (!pl->loop) {
+                spin_lock(&panel->playlistLock);
+                retire_playlist(panel);
+                spin_unlock(&panel->playlistLock);
+                return &panel->frames[panel->front];
+            }
+            panel->playlistEntry = 0;
+        }
+        panel->playlistEntryEnd = ktime_add_ns(panel->playlistEntryEnd, pl->durationNs[panel->playlistEntry]);
+        if (ktime_before(panel->playlistEntryEnd, now))
+            panel->playlistEntryEnd = now;     // Fell behind, don't race through the frames
+    }
+    return &pl->frames[panel->playlistEntry];
+}
+
+/** @brief Internal: Copies a panel's shown frame into its lane of the merged stream
+ *  Every panel is scanned with the bus's number of bit-planes. A binary frame
+ *  is lit through all of them and a gray frame with fewer planes than the bus
+ *  keeps to the most significant ones, which is as close as the shared
+ *  timing gets to its levels.
+ *
+ *  @param bus The bus
+ *  @param panel The panel whose lane to rewrite
+ */
+static void merge_lane(struct ledmsg_bus *bus, const struct ledmsg_panel *panel) {
+    const struct ledmsg_frame *frame = panel->shown;
+    size_t planeSize = bus->numRows * bus->streamSize;
+    unsigned int offset = bus->numPlanes - frame->numPlanes;
+    u8 *dst = bus->mergedStream;
+    u8 bit = BIT(panel->index);
+    const u8 *src;
+    unsigned int p;
+    size_t i;
+
+    for (p = 0; p < bus->numPlanes; ++p) {
+        if (frame->numPlanes == 1)
+            src = frame->stream;
+        else if (p >= offset)
+            src = frame->stream + (p - offset) * planeSize;
+        else
+            src = NULL;
+        for (i = 0; i < planeSize; ++i, ++dst)
+            *dst = (*dst & ~bit) | (src ? src[i] << panel->index : 0);
+    }
+}
+
+/** @brief Internal: Works out which rows of the bus stream are dark on every panel
+ *  Planes map onto the bus planes the way merge_lane() lays them out.
+ *  @param bus The bus, its panels' shown frames chosen
+ */
+static void merge_blank_rows(struct ledmsg_bus *bus) {
+    const struct ledmsg_frame *frame;
+    unsigned int p, i, offset;
+    u8 blank;
+
+    for (p = 0; p < bus->numPlanes; ++p) {
+        blank = 0xff;
+        for (i = 0; i < bus->numPanels; ++i) {
+            frame = bus->panels[i].shown;
+            offset = bus->numPlanes - frame->numPlanes;
+            if (frame->numPlanes == 1)
+                blank &= frame->blankRows[0];
+            else if (p >= offset)
+                blank &= frame->blankRows[p - offset];
+        }
+        bus->blankRows[p] = blank;
+    }
+}
+
+/** @brief Takes new content for every panel of a bus at a frame boundary
+ *  With one panel its compiled rows are scanned as they are. With more, each
+ *  panel's rows are merged into its lane of the bus stream, but only when the
+ *  panel shows a different frame or the frame was recompiled.
+ *
+ *  @param bus The bus
+ *  @param now The time of the frame boundary
+ */
+void ledmsg_bus_frame_boundary(struct ledmsg_bus *bus, ktime_t now) {
+    struct ledmsg_panel *panel;
+    struct ledmsg_frame *frame;
+    unsigned int i, numPlanes = 1;
+    bool remerge;
+
+    for (i = 0; i < bus->numPanels; ++i) {
+        panel = &bus->panels[i];
+        frame = frame_boundary(panel, now);
+        update_viewport(panel, now);
+        if (frame->viewX != panel->viewX || frame->viewY != panel->viewY)
+            compile_frame(panel, frame, panel->viewX, panel->viewY);
+        WRITE_ONCE(panel->shown, frame);
+        numPlanes = max(numPlanes, frame->numPlanes);
+    }
+
+    if (bus->numPanels == 1) {
+        bus->stream = bus->panels[0].shown->stream;
+        bus->numPlanes = numPlanes;
+        merge_blank_rows(bus);
+        return;
+    }
+
+    remerge = numPlanes != bus->numPlanes;
+    bus->numPlanes = numPlanes;
+    for (i = 0; i < bus->numPanels; ++i) {
+        panel = &bus->panels[i];
+        if (remerge || panel->shown->compileSeq != panel->mergedSeq) {
+            merge_lane(bus, panel);
+            panel->mergedSeq = panel->shown->compileSeq;
+        }
+    }
+    bus->stream = bus->mergedStream;
+    merge_blank_rows(bus);
+}
+
+/** @brief Adds a duration to a histogram
+ *  @param hist The histogram
+ *  @param ns The duration, negative ones count as 0
+ */
+void ledmsg_hist_add(struct ledmsg_hist *hist, s64 ns) {
+    u32 v = clamp_t(s64, ns, 0, U32_MAX);
+
+    ++hist->count[min_t(unsigned int, fls(v >> 10), LEDMSG_HIST_BUCKETS - 1)];
+    hist->avgNs = hist->avgNs - (hist->avgNs >> 4) + (v >> 4);
+    if (v > hist->maxNs)
+        hist->maxNs = v;
+}
+
+/** @brief Steps the scan to the next bit-plane or row and shifts its data in
+ *  Called by update_row while the previous step is still lit; the caller
+ *  latches the row with ledmsg_scan_latch() once that step's on time is up.
+ *  New content is only taken at a frame boundary, when the scan wraps to
+ *  row 0, so a frame never tears.
+ *
+ *  A step whose row is dark on every panel is not shifted in; the display is
+ *  blanked for its time slot instead, so it still takes its share of the
+ *  frame. With bus->skipRepeats set, a step the shift registers hold already
+ *  is not shifted in again either. When a step leaves the panels as they are,
+ *  a blank one after another or the same row again, there is nothing to do
+ *  at its deadline and the caller can sleep straight through to the next one.
+ *  The first step of a frame is always latched so the scan keeps sleeping
+ *  once per frame however dark the frame is.
+ *
+ *  @param bus The bus to scan
+ *  @return true if the step has to be latched at its deadline
+ */
+bool ledmsg_scan_shift(struct ledmsg_bus *bus) {
+    const u8 *stream;
+    bool first = false;
+
+    // Step to the next bit-plane, after the last one to the next row
+    if (++bus->plane >= bus->numPlanes) {
+        bus->plane = 0;
+        (bus->row + 1 < bus->numRows) ? ++bus->row : (bus->row = 0);
+
+        if (bus->row == 0) {
+            ledmsg_bus_frame_boundary(bus, ktime_get());
+            ++bus->stats.frames;
+            first = true;
+        }
+    }
+    stream = bus->stream + (bus->plane * bus->numRows + bus->row) * bus->streamSize;
+
+    bus->stepBlank = bus->output->blank && (bus->blankRows[bus->plane] & BIT(bus->row));
+    if (bus->stepBlank) {
+        ++bus->stats.blankSteps;
+        return first || !bus->blanked;
+    }
+
+    if (!READ_ONCE(bus->skipRepeats)) {
+        bus->shiftedValid = false;
+    } else if (bus->shiftedValid && !memcmp(stream, bus->shifted, bus->streamSize)) {
+        ++bus->stats.repeatSteps;
+        return first || bus->blanked || bus->latchedRow != bus->row;
+    } else {
+        memcpy(bus->shifted, stream, bus->streamSize);
+        bus->shiftedValid = true;
+    }
+
+    // Shift the row data in while the previous row is still displayed
+    bus->output->write_row(bus, stream);
+    return true;
+}
+
+/** @brief Shows the step ledmsg_scan_shift() got ready, at its deadline
+ *  @param bus The bus being scanned
+ */
+void ledmsg_scan_latch(struct ledmsg_bus *bus) {
+    if (bus->stepBlank) {
+        if (!bus->blanked)
+            bus->output->blank(bus);
+        bus->blanked = true;
+        return;
+    }
+    bus->output->latch_row(bus, bus->row);
+    bus->latchedRow = bus->row;
+    bus->blanked = false;
+}
+
+/** @brief How long the step just shifted in stays lit
+ *  Every row gets the same period whatever the number of planes; plane p gets
+ *  2^p / (2^numPlanes - 1) of it.
+ *
+ *  @param bus The bus being scanned
+ *  @param periodNs The row period
+ *  @return The on time of bus->plane in ns
+ */
+u64 ledmsg_scan_on_time(const struct ledmsg_bus *bus, u64 periodNs) {
+    return div_u64(periodNs << bus->plane, (1U << bus->numPlanes) - 1);
+}
+
+/** @brief Internal: Frees what panel_init() allocated for a panel
+ *  @param panel The panel, whose device must already be gone
+ */
+static void panel_free(struct ledmsg_panel *panel) {
+    int i;
+
+    ledmsg_free_playlist(panel->playlist);
+    ledmsg_free_playlist(panel->queuedPlaylist);
+    ledmsg_free_retired_playlists(panel);
+    for (i = 0; i < NUM_FRAMES; ++i) {
+        if (panel->frames[i].data)
+            free_pages_exact(panel->frames[i].data, panel->bus->frameStride);
+        kfree(panel->frames[i].stream);
+        panel->frames[i].data = NULL;
+        panel->frames[i].stream = NULL;
+    }
+    kvfree(panel->hexBuf);
+    kvfree(panel->grayBuf);
+    kvfree(panel->layerBuf);
+    kfree(panel->coverRow);
+    kvfree(panel->layerDraft.data);
+    panel->hexBuf = NULL;
+    panel->grayBuf = NULL;
+    panel->layerBuf = NULL;
+    panel->coverRow = NULL;
+    panel->layerDraft.data = NULL;
+}
+
+/** @brief Internal: Sets up a panel's buffers, the first frame shows the start up pattern
+ *  @param bus The bus the panel is on, its sizes must be set
+ *  @param panel The zeroed panel
+ *  @param index The panel's lane on the bus
+ *  @return 0 if successful, -ENOMEM otherwise. panel_free() cleans up either way.
+ */
+static int panel_init(struct ledmsg_bus *bus, struct ledmsg_panel *panel, unsigned int index) {
+    unsigned int rows = min_t(unsigned int, bus->numRows, LEDMSG_NUM_ROWS);
+    unsigned int rowBytes = min_t(unsigned int, bus->rowBytes, LEDMSG_NUM_ROW_BYTES);
+    int result = -ENOMEM;
+    unsigned int i;
+
+    panel->bus = bus;
+    panel->index = index;
+    panel->back = 2;
+    atomic_set(&panel->pending, 1);
+    atomic_set(&panel->compileSeq, 0);
+    mutex_init(&panel->writeLock);
+    init_waitqueue_head(&panel->frameWait);
+    spin_lock_init(&panel->viewLock);
+    spin_lock_init(&panel->playlistLock);
+    INIT_LIST_HEAD(&panel->retiredPlaylists);
+    INIT_LIST_HEAD(&panel->layers);
+
+    panel->hexBuf = kvmalloc(bus->canvasBytes * 2, GFP_KERNEL);
+    CHECK(panel->hexBuf, "failed to allocate the hex decode buffer of panel %u", index);
+    panel->grayBuf = kvmalloc(bus->canvasBytes * 8, GFP_KERNEL);
+    CHECK(panel->grayBuf, "failed to allocate the gray decode buffer of panel %u", index);
+
+    // Allocate the page backed frame buffers, the first one is shown at start up
+    for (i = 0; i < NUM_FRAMES; ++i) {
+        panel->frames[i].data = alloc_pages_exact(bus->frameStride, GFP_KERNEL | __GFP_ZERO);
+        CHECK(panel->frames[i].data, "failed to allocate frame buffer %u of panel %u", i, index);
+        panel->frames[i].stream = kmalloc_array(LEDMSG_MAX_GRAY_BITS * bus->numRows, bus->streamSize, GFP_KERNEL);
+        CHECK(panel->frames[i].stream, "failed to allocate compiled rows %u of panel %u", i, index);
+        panel->frames[i].numPlanes = 1;
+        panel->frames[i].composed = panel->frames[i].data;
+        compile_frame(panel, &panel->frames[i], 0, 0);
+    }
+    for (i = 0; i < rows; ++i)
+        memcpy(panel->frames[0].data + i * bus->canvasRowBytes, initPattern[i], rowBytes);
+    compile_frame(panel, &panel->frames[0], 0, 0);
+    panel->frames[1].staleRows = panel->frames[2].staleRows = LEDMSG_ALL_ROWS;
+    result = 0;
+error:
+    return result;
+}
+
+/** @brief Works out the sizes of a bus, the canvas is at least as large as a panel
+ *  @param bus The bus, its backend must be set
+ *  @param rows Rows per panel
+ *  @param rowBytes Bytes of pixels per panel row
+ *  @param canvasWidth Canvas width in pixels, 0 for the panel width
+ *  @param canvasHeight Canvas height in pixels, 0 for the panel height
+ */
+void ledmsg_bus_size(struct ledmsg_bus *bus, unsigned int rows, unsigned int rowBytes,
+                     unsigned int canvasWidth, unsigned int canvasHeight) {
+    bus->numRows = clamp_t(unsigned int, rows, 1, MAX_ROWS);
+    bus->rowBytes = clamp_t(unsigned int, rowBytes, 1, LEDMSG_MAX_ROW_BYTES);
+    bus->rowBits = bus->rowBytes * 8;
+    bus->streamSize = bus->rowBytes * bus->output->streamScale;
+    bus->canvasWidth = clamp_t(unsigned int, ALIGN(canvasWidth, 8), bus->rowBits, LEDMSG_MAX_CANVAS_WIDTH);
+    bus->canvasHeight = clamp_t(unsigned int, canvasHeight, bus->numRows, LEDMSG_MAX_CANVAS_HEIGHT);
+    bus->canvasRowBytes = bus->canvasWidth / 8;
+    bus->canvasBytes = bus->canvasRowBytes * bus->canvasHeight;
+    bus->frameStride = PAGE_ALIGN(LEDMSG_MAX_GRAY_BITS * bus->canvasBytes);
+}
+
+/** @brief Allocates the panels of a bus and gets the scan ready to start
+ *  @param bus The bus, sized by ledmsg_bus_size() and with numPanels set
+ *  @return 0 if successful, -ENOMEM otherwise. ledmsg_bus_free() cleans up either way.
+ */
+int ledmsg_bus_init(struct ledmsg_bus *bus) {
+    int result = -ENOMEM;
+    unsigned int i;
+
+    bus->panels = kcalloc(bus->numPanels, sizeof *bus->panels, GFP_KERNEL);
+    CHECK(bus->panels, "failed to allocate the panels");
+    for (i = 0; i < bus->numPanels; ++i) {
+        result = panel_init(bus, &bus->panels[i], i);
+        if (result)
+            goto error;
+    }
+    result = -ENOMEM;
+    if (bus->numPanels > 1) {
+        bus->mergedStream = kcalloc(LEDMSG_MAX_GRAY_BITS * bus->numRows, bus->streamSize, GFP_KERNEL);
+        CHECK(bus->mergedStream, "failed to allocate the merged rows");
+    }
+    bus->shifted = kmalloc(bus->streamSize, GFP_KERNEL);
+    CHECK(bus->shifted, "failed to allocate the copy of the shifted row");
+    bus->row = 0;
+    bus->plane = 0;
+    bus->numPlanes = 0;
+    bus->shiftedValid = false;
+    bus->blanked = true;                // Nothing was latched yet
+    result = 0;
+error:
+    return result;
+}
+
+/** @brief Frees what ledmsg_bus_init() allocated
+ *  @param bus The bus, which must not be scanned any more
+ */
+void ledmsg_bus_free(struct ledmsg_bus *bus) {
+    unsigned int i;
+
+    if (bus->panels) {
+        for (i = 0; i < bus->numPanels; ++i)
+            if (bus->panels[i].bus)
+                panel_free(&bus->panels[i]);
+    }
+    kfree(bus->panels);
+    kfree(bus->mergedStream);
+    kfree(bus->shifted);
+    bus->panels = NULL;
+    bus->mergedStream = NULL;
+    bus->shifted = NULL;
+}
@@ -0,0 +1,301 @@
+/**
+ * @file   ledmsg_core.h
+ * @author David Good
+ * @date   16 October 2026
+ * @version 0.1
+ * @brief  The scan engine of the ledmsgchar LKM: frames, panels and buses,
+ * frame decoding and compiling, the buffer handoff to the scan thread and the
+ * row scan step. There is no GPIO, file or module code in here, so the same
+ * source builds into the LKM and, on top of ledmsg_compat.h, into the
+ * userspace simulator and benchmark.
+ */
+#ifndef LEDMSG_CORE_H
+#define LEDMSG_CORE_H
+
+#ifdef __KERNEL__
+#include <linux/kernel.h>         // Contains types, macros, functions for the kernel
+#include <linux/types.h>          // Required for u8 type
+#include <linux/atomic.h>         // Lock free handoff of frame buffers to update_row
+#include <linux/spinlock.h>       // Guards the playlist handoff to update_row
+#include <linux/mutex.h>          // Serializes writers on the back buffer
+#include <linux/wait.h>           // Wait queue used to signal that a frame was taken
+#include <linux/list.h>           // Retired playlists waiting to be freed
+#include <linux/ktime.h>          // Required for ktime_get() and friends
+#else
+#include "ledmsg_compat.h"        // Userspace stand-ins for the kernel APIs used here
+#endif
+#include "ledmsgchar.h"           // Frame geometry, formats and ioctls shared with userspace
+
+#define LOG_ALERT(M, ...) printk(KERN_ALERT "LEDMSGCHAR: " M "\n", ##__VA_ARGS__)
+#define LOG_INFO(M, ...)  printk(KERN_INFO  "LEDMSGCHAR: " M "\n", ##__VA_ARGS__)
+#define LOG_DEBUG(M, ...) pr_debug("LEDMSGCHAR: " M "\n", ##__VA_ARGS__)
+#define CHECK(A, M, ...) if (!(A)) { LOG_ALERT(M, ##__VA_ARGS__); goto error; }
+
+#define MAX_ROWS 8                      ///< Rows the three row address lines can select
+
+/* Triple buffering: each frame buffer owns whole pages so it can be handed to mmap().
+ * update_row owns a panel's front buffer and the writers own its back buffer. The
+ * third buffer is handed between them with atomic exchanges of the pending word,
+ * which holds its index plus FRAME_DIRTY when it carries a frame that was not shown yet. */
+#define NUM_FRAMES       LEDMSG_MMAP_FRAMES
+#define FRAME_INDEX_MASK 0x3
+#define FRAME_DIRTY      0x4
+/** @brief A frame buffer together with the row output compiled from it
+ *  Frames change tens of times a second while rows are scanned thousands of
+ *  times a second, so the pixels are turned into backend output once, when the
+ *  frame is committed, and the scan loop only replays the compiled rows.
+ *
+ *  A frame is made of one or more bit-planes shown with binary coded
+ *  modulation: each row shows plane p for 2^p / (2^numPlanes - 1) of the row
+ *  period, so N bits of gray cost N scans of a row instead of 2^N.
+ */
+struct ledmsg_frame {
+    u8 *data;                           ///< Canvas sized planes in the [plane][row][byte] layout
+    u8 *composed;                       ///< What stream is compiled from: data, or layered when there are layers
+    u8 *layered;                        ///< Room for data with the layers on top, NULL until a layer is made and in playlists
+    u8 *stream;                         ///< [plane][row] compiled rows of bus->streamSize bytes
+    unsigned int numPlanes;             ///< Bit-planes in use, 1 for binary frames
+    unsigned int viewX;                 ///< Canvas column the rows were compiled from
+    unsigned int viewY;                 ///< Canvas row the rows were compiled from
+    unsigned int compileSeq;            ///< Changes each time stream is rewritten
+    unsigned int compiledPlanes;        ///< Bit-planes in stream
+    u64 seq;                            ///< Number of the frame, from ledmsg_panel.frameSeq, under writeLock
+    u8 blankRows[LEDMSG_MAX_GRAY_BITS]; ///< Per plane, bit r set if panel row r of stream is all dark
+
+    /* Partial updates, see ledmsg_edit_back(). Bit r stands for canvas row r. */
+    u64 staleRows;                      ///< Rows whose data is older than the newest frame, under writeLock
+    u64 dirtyRows;                      ///< Rows whose data changed since stream was compiled, under writeLock
+};
+#define LEDMSG_ALL_ROWS (~0ULL)         ///< Row mask of a whole frame, canvases are at most 64 rows
+
+/** @brief A batch of frames from LEDMSG_IOC_QUEUE, played by update_row
+ *  Writers build it and hand it over through queuedPlaylist. update_row owns
+ *  it while it plays and puts it on retiredPlaylists when done; writers free
+ *  it from there, so update_row never frees memory.
+ */
+struct ledmsg_playlist {
+    struct list_head node;              ///< Entry in retiredPlaylists
+    unsigned int count;                 ///< Number of frames
+    bool loop;                          ///< Start over after the last frame
+    ktime_t start;                      ///< When to show the first frame
+    u8 *data;                           ///< Planes of all the frames in one block
+    u64 *durationNs;                    ///< Display time of each frame, 0 for one scan pass
+    struct ledmsg_frame frames[];       ///< The compiled frames
+};
+
+/** @brief The layer of an open file, drawn over the frames of its panel
+ *  The frame written without a layer is at the bottom and the layers are
+ *  stacked on top of it by z. A layer is canvas sized and placed with its top
+ *  left corner at x, y, wrapping around the canvas edges like the viewport.
+ *  Where it covers the frame below, its pixels replace that frame's; see
+ *  LEDMSG_LAYER_OPAQUE for which pixels cover. All under the panel's writeLock.
+ */
+struct ledmsg_panel_layer {
+    struct list_head node;              ///< Entry in ledmsg_panel.layers
+    struct ledmsg_frame frame;          ///< The layer's pixels, only data and numPlanes are used
+    u8 *mask;                           ///< Canvas sized bitmap of the pixels that cover, NULL to go by the flags
+    s32 z;                              ///< Stacking order, higher is on top
+    unsigned int x;                     ///< Canvas column of the left edge, a multiple of 8
+    unsigned int y;                     ///< Canvas row of the top edge
+    u32 flags;                          ///< LEDMSG_LAYER_* flags
+};
+
+/* Statistics: cheap enough to keep on all the time. Every field has a single
+ * writer (update_row, or the writers under writeLock) and readers take them as
+ * they are, so a reading may mix two moments but never blocks the scan. */
+#define LEDMSG_HIST_BUCKETS 16          ///< Buckets of a struct ledmsg_hist
+
+/** @brief A histogram of durations on a log2 scale
+ *  Bucket 0 counts durations under 1024 ns, bucket b those in
+ *  [2^(b-1), 2^b) * 1024 ns and the last bucket everything longer.
+ */
+struct ledmsg_hist {
+    unsigned long count[LEDMSG_HIST_BUCKETS]; ///< Durations per bucket
+    u32 avgNs;                          ///< Moving average over roughly the last 16 durations
+    u32 maxNs;                          ///< Longest duration
+};
+
+/** @brief How the scan of a bus keeps time, written by update_row */
+struct ledmsg_scan_stats {
+    unsigned long steps;                ///< Rows or bit-planes latched
+    unsigned long frames;               ///< Frame boundaries
+    unsigned long missed;               ///< Deadlines that had passed by the time the row was shifted in
+    unsigned long resyncs;              ///< Times the scan fell a whole row behind and started over
+    unsigned long blankSteps;           ///< Steps of all dark rows, blanked instead of shifted in
+    unsigned long repeatSteps;          ///< Steps not shifted in again since the shift registers held them already
+    u32 targetPeriodNs;                 ///< Row period asked for
+    struct ledmsg_hist period;          ///< Actual row period, from one latch of plane 0 to the next
+    struct ledmsg_hist late;            ///< How late rows were latched after their deadline, the scan jitter
+    struct ledmsg_hist shift;           ///< Time to shift a row in
+};
+
+/** @brief How a panel's frames fared */
+struct ledmsg_panel_stats {
+    unsigned long committed;            ///< Frames handed to update_row, under writeLock
+    unsigned long overwritten;          ///< Frames replaced before update_row showed them, under writeLock
+    unsigned long waits;                ///< Writers that waited for update_row to take a frame, under writeLock
+    struct ledmsg_hist wait;            ///< How long they waited, under writeLock
+    unsigned long shown;                ///< Frames update_row took, written by update_row
+};
+
+#define MAX_SCROLL_SPEED 65536          ///< Fastest scroll LEDMSG_IOC_SET_VIEWPORT takes, pixels per second
+
+struct ledmsg_bus;
+
+/** @brief A panel: one /dev/ledmsgcharN with its own frames, viewport and batch
+ *  The panels of a bus share its clock, strobe, blank and row address lines
+ *  and each have a data line of their own, so they all shift in together.
+ */
+struct ledmsg_panel {
+    struct ledmsg_bus *bus;             ///< The bus the panel is on
+    unsigned int index;                 ///< Data lane on the bus, also the minor number
+    struct device *device;              ///< The panel's /dev/ledmsgcharN
+
+    struct ledmsg_frame frames[NUM_FRAMES]; ///< The triple buffered frames, physically contiguous pages
+    unsigned int front;                 ///< Index of the frame buffer being scanned out
+    unsigned int back;                  ///< Index of the frame buffer being filled, under writeLock
+    unsigned int latest;                ///< Index of the frame buffer published last, under writeLock
+    u64 frameSeq;                       ///< Number of the newest frame, under writeLock
+    atomic_t pending;                   ///< Index of the buffer in between, plus FRAME_DIRTY
+    atomic_t compileSeq;                ///< Source of ledmsg_frame.compileSeq
+    struct mutex writeLock;             ///< Serializes the writers on the back buffer
+    wait_queue_head_t frameWait;        ///< Woken by update_row each time it takes a frame
+    char *hexBuf;                       ///< Hex text being decoded, canvasBytes * 2, under writeLock
+    u8 *grayBuf;                        ///< Grayscale pixels being split into planes, under writeLock
+    u8 textBuf[LEDMSG_MAX_TEXT_BYTES];  ///< Text being drawn, under writeLock
+
+    /* Layers: composited into the back buffer when it is committed, under writeLock */
+    struct list_head layers;            ///< The ledmsg_panel_layer of each file that has one, bottom to top
+    u8 *layerBuf;                       ///< The layered planes of all frames, allocated with the first layer
+    u8 *coverRow;                       ///< Which pixels of a layer row cover, while compositing
+    struct ledmsg_frame layerDraft;     ///< A layer being written, see ledmsg_edit_layer(); only data and numPlanes are used
+
+    /* Viewport: set by LEDMSG_IOC_SET_VIEWPORT, applied and advanced by update_row */
+    spinlock_t viewLock;                ///< Guards requestedView and requestedViewTime
+    struct ledmsg_viewport requestedView; ///< Last viewport asked for
+    ktime_t requestedViewTime;          ///< When requestedView was asked for
+    unsigned int viewGen;               ///< Bumped each time requestedView changes
+    struct ledmsg_viewport engineView;  ///< update_row's copy of requestedView
+    ktime_t engineViewTime;             ///< update_row's copy of requestedViewTime
+    unsigned int engineViewGen;         ///< viewGen of engineView
+    unsigned int viewX;                 ///< Canvas column shown at the left of the panel, set by update_row
+    unsigned int viewY;                 ///< Canvas row shown at the top of the panel, set by update_row
+
+    /* Batches: handed over under playlistLock, played by update_row */
+    spinlock_t playlistLock;            ///< Guards queuedPlaylist, retiredPlaylists and stopPlaylist
+    struct ledmsg_playlist *queuedPlaylist; ///< Waiting for update_row to pick it up
+    struct list_head retiredPlaylists;  ///< Done with by update_row, to be freed
+    bool stopPlaylist;                  ///< Set by LEDMSG_IOC_QUEUE_STOP
+    struct ledmsg_playlist *playlist;   ///< Playing, owned by update_row
+    unsigned int playlistEntry;         ///< Index of the frame of playlist being shown
+    bool playlistStarted;               ///< Whether playlist's start time was reached
+    ktime_t playlistEntryEnd;           ///< When to move on to the next frame of playlist
+
+    const struct ledmsg_frame *shown;   ///< Frame update_row shows, never one of a retired playlist
+    unsigned int mergedSeq;             ///< compileSeq of shown when it was merged into the bus
+
+    struct ledmsg_panel_stats stats;    ///< Frame statistics
+};
+
+/** @brief Output backend: how row data and row changes reach the sign
+ *  The scan loop only talks to the sign through one of these. The LKM picks
+ *  one at load time with the backend module parameter; the simulator has a
+ *  mock of its own.
+ */
+struct ledmsg_backend {
+    const char *name;                                           ///< Value of the backend parameter
+    unsigned int streamScale;                                   ///< Bytes of compiled output per byte of pixels
+    bool noDataGpios;                                           ///< D0 and CLK belong to another driver
+    bool parallel;                                              ///< Can shift several panels at once
+    int  (*init)(struct ledmsg_bus *bus);                       ///< Optional, 0 if usable
+    void (*exit)(struct ledmsg_bus *bus);                       ///< Optional
+    void (*compile_row)(const struct ledmsg_bus *bus, const u8 *rowData, u8 *stream); ///< Turn a row of pixels into output
+    void (*write_row)(struct ledmsg_bus *bus, const u8 *stream);    ///< Shift one compiled row in
+    void (*latch_row)(struct ledmsg_bus *bus, unsigned int rowNum); ///< Blank, select the row and latch
+    void (*blank)(struct ledmsg_bus *bus);                      ///< Optional, turn every row off until the next latch_row
+};
+
+/** @brief A bus: the lines a set of panels share and the thread that scans them
+ *  Geometry is the same for every panel on a bus since they share the clock
+ *  and row address lines. Rows of several panels are shifted in parallel: in
+ *  the compiled level stream, bit k of every byte is the data line of panel k.
+ */
+struct ledmsg_bus {
+    const struct ledmsg_backend *output; ///< The backend in use
+    void *priv;                         ///< The backend's own state
+    unsigned int numRows;               ///< Rows per panel
+    unsigned int rowBytes;              ///< Bytes of pixels per panel row
+    unsigned int rowBits;               ///< Pixels per panel row
+    size_t streamSize;                  ///< Bytes of compiled output per row
+    unsigned int canvasWidth;           ///< Canvas width in pixels, a multiple of 8
+    unsigned int canvasHeight;          ///< Canvas height in pixels
+    unsigned int canvasRowBytes;        ///< Bytes per canvas row
+    size_t canvasBytes;                 ///< Bytes per canvas bit-plane
+    size_t frameStride;                 ///< Page aligned size of a frame buffer, also the mmap() stride
+
+    unsigned int numPanels;             ///< Panels on the bus, one per data line
+    struct ledmsg_panel *panels;        ///< The panels, indexed by minor number
+
+    struct task_struct *task;           ///< The scan thread
+    unsigned int row;                   ///< Current row being scanned
+    unsigned int plane;                 ///< Current bit-plane of the row being scanned
+    const u8 *stream;                   ///< Compiled rows being scanned, [plane][row]
+    unsigned int numPlanes;             ///< Bit-planes in stream
+    u8 *mergedStream;                   ///< All the panels' lanes when there is more than one panel
+    u8 blankRows[LEDMSG_MAX_GRAY_BITS]; ///< Per plane, bit r set if row r of stream is all dark on every panel
+
+    /* What the panels hold, for skipping steps that would change nothing */
+    bool skipRepeats;                   ///< Idle policy: don't shift in what the shift registers hold already
+    bool stepBlank;                     ///< The step shifted last is all dark
+    bool blanked;                       ///< The display was turned off with blank()
+    bool shiftedValid;                  ///< shifted holds what the shift registers hold
+    unsigned int latchedRow;            ///< Row selected by the last latch_row
+    u8 *shifted;                        ///< Copy of the stream shifted in last, streamSize bytes
+
+    struct ledmsg_scan_stats stats;     ///< Scan statistics
+};
+
+/* Set up */
+void ledmsg_build_glyph_cache(void);
+const u8 *ledmsg_font_columns(u32 c);
+void ledmsg_bus_size(struct ledmsg_bus *bus, unsigned int rows, unsigned int rowBytes,
+                     unsigned int canvasWidth, unsigned int canvasHeight);
+int  ledmsg_bus_init(struct ledmsg_bus *bus);
+void ledmsg_bus_free(struct ledmsg_bus *bus);
+
+/* Writer side */
+void ledmsg_compile_levels(const struct ledmsg_bus *bus, const u8 *rowData, u8 *stream);
+void ledmsg_commit_frame(struct ledmsg_panel *panel, struct ledmsg_frame *frame);
+void ledmsg_commit_rows(struct ledmsg_panel *panel, struct ledmsg_frame *frame);
+int  ledmsg_decode_hex(const char *hex, u8 *data, size_t numBytes);
+void ledmsg_gray_to_planes(const struct ledmsg_bus *bus, const u8 *pixels, unsigned int numPlanes,
+                           u8 *planes, size_t numBytes);
+void ledmsg_encode_hex(const u8 *data, char *hex, size_t numBytes);
+void ledmsg_planes_to_gray(const struct ledmsg_bus *bus, const u8 *planes, unsigned int numPlanes, u8 *pixels);
+void ledmsg_render_text(const struct ledmsg_bus *bus, const struct ledmsg_text *attr,
+                        const u8 *text, size_t len, struct ledmsg_frame *frame);
+bool ledmsg_frame_pending(struct ledmsg_panel *panel);
+struct ledmsg_frame *ledmsg_edit_back(struct ledmsg_panel *panel, unsigned int numPlanes);
+void ledmsg_publish_back(struct ledmsg_panel *panel);
+void ledmsg_publish_rows(struct ledmsg_panel *panel, u64 rows);
+const struct ledmsg_frame *ledmsg_shown_frame(struct ledmsg_panel *panel);
+void ledmsg_free_playlist(struct ledmsg_playlist *pl);
+void ledmsg_free_retired_playlists(struct ledmsg_panel *panel);
+struct ledmsg_panel_layer *ledmsg_layer_alloc(struct ledmsg_panel *panel);
+void ledmsg_layer_free(struct ledmsg_panel_layer *layer);
+void ledmsg_layer_place(struct ledmsg_panel *panel, struct ledmsg_panel_layer *layer);
+struct ledmsg_frame *ledmsg_edit_layer(struct ledmsg_panel *panel, struct ledmsg_panel_layer *layer,
+                                       unsigned int numPlanes);
+void ledmsg_commit_layer(struct ledmsg_panel *panel, struct ledmsg_panel_layer *layer);
+u64  ledmsg_layer_rows(const struct ledmsg_bus *bus, const struct ledmsg_panel_layer *layer, u64 rows);
+
+/* Statistics */
+void ledmsg_hist_add(struct ledmsg_hist *hist, s64 ns);
+
+/* Scan side */
+void ledmsg_bus_frame_boundary(struct ledmsg_bus *bus, ktime_t now);
+bool ledmsg_scan_shift(struct ledmsg_bus *bus);
+void ledmsg_scan_latch(struct ledmsg_bus *bus);
+u64  ledmsg_scan_on_time(const struct ledmsg_bus *bus, u64 periodNs);
+
+#endif /* LEDMSG_CORE_H */
@@ -0,0 +1,282 @@
+/**
+ * @file   ledmsg_sim.c
+ * @author David Good
+ * @date   16 October 2026
+ * @version 0.1
+ * @brief  Userspace simulator of a ledmsgchar bus, see ledmsg_sim.h.
+ */
+
+#include "ledmsg_sim.h"
+
+#define SIM_ADDRESS_PINS (BIT(SIM_PIN_A0) | BIT(SIM_PIN_A1) | BIT(SIM_PIN_A2))
+
+/** @brief Internal: Adds the time since the last call to every LED that was lit
+ *  Must be called before anything that changes what is lit.
+ *  @param sim The simulator
+ */
+static void sim_account(struct ledmsg_sim *sim) {
+    const struct ledmsg_bus *bus = &sim->bus;
+    u64 elapsed = sim->nowNs - sim->lastAccountNs;
+    unsigned int row = (sim->levels & SIM_ADDRESS_PINS) >> SIM_PIN_A0;
+    const u8 *latch;
+    u64 *lit;
+    unsigned int k, i;
+
+    sim->lastAccountNs = sim->nowNs;
+    sim->totalNs += elapsed;
+    if (!elapsed || (sim->levels & BIT(SIM_PIN_BLK)) || row >= bus->numRows)
+        return;
+    for (k = 0; k < bus->numPanels; ++k) {
+        latch = sim->latch + k * bus->rowBits;
+        lit = sim->litNs + (k * bus->numRows + row) * bus->rowBits;
+        for (i = 0; i < bus->rowBits; ++i)
+            if (latch[i])
+                lit[i] += elapsed;
+    }
+}
+
+/** @brief Internal: Copies every panel's shift register into its output latch on a rising STB
+ *  The first bit shifted in has travelled furthest, to the leftmost pixel.
+ *  @param sim The simulator
+ */
+static void sim_strobe(struct ledmsg_sim *sim) {
+    const struct ledmsg_bus *bus = &sim->bus;
+    unsigned int k, i, pos;
+
+    for (k = 0; k < bus->numPanels; ++k)
+        for (i = 0, pos = sim->shiftHead; i < bus->rowBits; ++i) {
+            sim->latch[k * bus->rowBits + i] = sim->shiftReg[k * bus->rowBits + pos];
+            pos = (pos + 1 == bus->rowBits) ? 0 : pos + 1;
+        }
+}
+
+/** @brief Internal: Clocks the data lines into every panel's shift register on a rising CLK
+ *  @param sim The simulator
+ *  @param levels The pin levels at the clock edge
+ */
+static void sim_clock(struct ledmsg_sim *sim, u32 levels) {
+    const struct ledmsg_bus *bus = &sim->bus;
+    unsigned int k;
+
+    for (k = 0; k < bus->numPanels; ++k)
+        sim->shiftReg[k * bus->rowBits + sim->shiftHead] = (levels >> k) & 1;
+    sim->shiftHead = (sim->shiftHead + 1 == bus->rowBits) ? 0 : sim->shiftHead + 1;
+}
+
+/** @brief Internal: One array write of the mock backend, like gpiod_set_raw_array_value()
+ *  @param sim The simulator
+ *  @param mask The pins written
+ *  @param values Their new levels, bit n for pin n
+ */
+static void sim_write(struct ledmsg_sim *sim, u32 mask, u32 values) {
+    u32 levels = (sim->levels & ~mask) | (values & mask);
+    u32 changed = sim->levels ^ levels;
+    struct ledmsg_sim_edge *e;
+    unsigned int pin;
+
+    ++sim->gpioOps;
+    if (!changed)
+        return;
+    sim->edges += __builtin_popcount(changed);
+    for (pin = 0; sim->edgeLogSize && pin < SIM_NUM_PINS; ++pin) {
+        if (!(changed & BIT(pin)) || sim->edgeLogCount == sim->edgeLogSize)
+            continue;
+        e = &sim->edgeLog[sim->edgeLogCount++];
+        e->timeNs = sim->nowNs;
+        e->pin = pin;
+        e->level = (levels >> pin) & 1;
+    }
+
+    if (changed & (BIT(SIM_PIN_BLK) | SIM_ADDRESS_PINS | BIT(SIM_PIN_STB)))
+        sim_account(sim);
+    if ((changed & levels) & BIT(SIM_PIN_CLK))
+        sim_clock(sim, levels);
+    sim->levels = levels;
+    if ((changed & levels) & BIT(SIM_PIN_STB))
+        sim_strobe(sim);
+}
+
+/** @brief Internal: Shifts a compiled row in with two array writes per bit, like gpiod_write_row()
+ *  @param bus The simulated bus
+ *  @param stream bus->rowBits lane bitmaps, bit k for the data line of panel k
+ */
+static void sim_write_row(struct ledmsg_bus *bus, const u8 *stream) {
+    struct ledmsg_sim *sim = bus->priv;
+    u32 mask = BIT(bus->numPanels) - 1;
+    u32 clk = BIT(SIM_PIN_CLK);
+    unsigned int i;
+
+    mask |= clk;
+    for (i = 0; i < bus->rowBits; ++i) {
+        sim_write(sim, mask, stream[i]);
+        sim_write(sim, mask, stream[i] | clk);
+    }
+    sim_write(sim, mask, stream[bus->rowBits - 1]);     // Leave the clock low
+    ++sim->rowsShifted;
+}
+
+/** @brief Internal: Blanks, selects the row and latches with three array writes, like gpiod_latch_row()
+ *  @param bus The simulated bus
+ *  @param rowNum The row whose data was just shifted in
+ */
+static void sim_latch_row(struct ledmsg_bus *bus, unsigned int rowNum) {
+    struct ledmsg_sim *sim = bus->priv;
+    u32 mask = BIT(SIM_PIN_BLK) | SIM_ADDRESS_PINS | BIT(SIM_PIN_STB);
+    u32 lines;
+
+    lines = BIT(SIM_PIN_BLK) | ((rowNum & 7) << SIM_PIN_A0);
+    sim_write(sim, mask, lines);
+    lines |= BIT(SIM_PIN_STB);
+    sim_write(sim, mask, lines);
+    lines &= ~(BIT(SIM_PIN_STB) | BIT(SIM_PIN_BLK));
+    sim_write(sim, mask, lines);
+    ++sim->rowsLatched;
+}
+
+/** @brief Internal: Turns every row off with one array write, like gpiod_blank()
+ *  @param bus The simulated bus
+ */
+static void sim_blank(struct ledmsg_bus *bus) {
+    struct ledmsg_sim *sim = bus->priv;
+
+    sim_write(sim, BIT(SIM_PIN_BLK), BIT(SIM_PIN_BLK));
+    ++sim->blanks;
+}
+
+static const struct ledmsg_backend simBackend = {
+    .name = "sim",
+    .streamScale = 8,
+    .parallel = true,
+    .compile_row = ledmsg_compile_levels,
+    .write_row = sim_write_row,
+    .latch_row = sim_latch_row,
+    .blank = sim_blank,
+};
+
+/** @brief Sets up a simulated bus, blanked until the first row is latched
+ *  @param sim The zeroed simulator
+ *  @param rows Rows per panel
+ *  @param rowBytes Bytes of pixels per panel row
+ *  @param canvasWidth Canvas width in pixels, 0 for the panel width
+ *  @param canvasHeight Canvas height in pixels, 0 for the panel height
+ *  @param numPanels Panels on the bus, 1 to LEDMSG_MAX_PANELS
+ *  @return 0 if successful, a negative error code otherwise. ledmsg_sim_free() cleans up either way.
+ */
+int ledmsg_sim_init(struct ledmsg_sim *sim, unsigned int rows, unsigned int rowBytes,
+                    unsigned int canvasWidth, unsigned int canvasHeight, unsigned int numPanels) {
+    struct ledmsg_bus *bus = &sim->bus;
+    int result;
+
+    if (numPanels < 1 || numPanels > LEDMSG_MAX_PANELS)
+        return -EINVAL;
+    bus->output = &simBackend;
+    bus->priv = sim;
+    ledmsg_bus_size(bus, rows, rowBytes, canvasWidth, canvasHeight);
+    bus->numPanels = numPanels;
+    ledmsg_build_glyph_cache();
+    result = ledmsg_bus_init(bus);
+    if (result)
+        return result;
+
+    sim->shiftReg = kcalloc(numPanels, bus->rowBits, GFP_KERNEL);
+    sim->latch = kcalloc(numPanels, bus->rowBits, GFP_KERNEL);
+    sim->litNs = kcalloc(numPanels * bus->numRows * bus->rowBits, sizeof *sim->litNs, GFP_KERNEL);
+    if (!sim->shiftReg || !sim->latch || !sim->litNs)
+        return -ENOMEM;
+    sim->levels = BIT(SIM_PIN_BLK);
+    sim->rowPeriodNs = 2000000;
+    ledmsg_bus_frame_boundary(bus, ktime_get());
+    return 0;
+}
+
+/** @brief Frees what ledmsg_sim_init() and ledmsg_sim_record() allocated
+ *  @param sim The simulator
+ */
+void ledmsg_sim_free(struct ledmsg_sim *sim) {
+    ledmsg_bus_free(&sim->bus);
+    kfree(sim->shiftReg);
+    kfree(sim->latch);
+    kfree(sim->litNs);
+    kfree(sim->edgeLog);
+    sim->shiftReg = sim->latch = NULL;
+    sim->litNs = NULL;
+    sim->edgeLog = NULL;
+}
+
+/** @brief Starts keeping the pin edges in sim->edgeLog
+ *  @param sim The simulator
+ *  @param maxEdges Edges to keep, later ones are only counted
+ *  @return 0 if successful, -ENOMEM otherwise
+ */
+int ledmsg_sim_record(struct ledmsg_sim *sim, size_t maxEdges) {
+    kfree(sim->edgeLog);
+    sim->edgeLogCount = 0;
+    sim->edgeLogSize = 0;
+    sim->edgeLog = kmalloc_array(maxEdges, sizeof *sim->edgeLog, GFP_KERNEL);
+    if (!sim->edgeLog)
+        return -ENOMEM;
+    sim->edgeLogSize = maxEdges;
+    return 0;
+}
+
+/** @brief Clears the counters, the edge log and the lit times
+ *  The reconstructed image then starts with the step lit right now.
+ *  @param sim The simulator
+ */
+void ledmsg_sim_reset(struct ledmsg_sim *sim) {
+    const struct ledmsg_bus *bus = &sim->bus;
+
+    sim->gpioOps = 0;
+    sim->edges = 0;
+    sim->rowsShifted = 0;
+    sim->rowsLatched = 0;
+    sim->blanks = 0;
+    sim->wakeups = 0;
+    sim->edgeLogCount = 0;
+    sim->lastAccountNs = sim->nowNs;
+    sim->totalNs = 0;
+    memset(sim->litNs, 0, bus->numPanels * bus->numRows * bus->rowBits * sizeof *sim->litNs);
+}
+
+/** @brief Scans the bus like update_row does, on simulated time
+ *  Each step shifts the next row or bit-plane in, lets the simulated clock run
+ *  through the on time of the step before it and latches, without sleeping.
+ *  Steps ledmsg_scan_shift() says need no latch are run through the same way
+ *  update_row sleeps through them.
+ *  @param sim The simulator
+ *  @param steps Steps to scan, numRows * numPlanes of them make a frame
+ */
+void ledmsg_sim_run(struct ledmsg_sim *sim, unsigned long steps) {
+    struct ledmsg_bus *bus = &sim->bus;
+    bool latch;
+
+    while (steps--) {
+        latch = ledmsg_scan_shift(bus);
+        sim->nowNs += sim->onTimeNs;
+        sim->onTimeNs = ledmsg_scan_on_time(bus, sim->rowPeriodNs);
+        if (!latch)
+            continue;
+        ++sim->wakeups;
+        ledmsg_scan_latch(bus);
+    }
+}
+
+/** @brief Reconstructs what a panel showed since ledmsg_sim_reset()
+ *  Each LED gets the share of its row's time it was lit, a row's time being
+ *  an equal share of the total whether it was lit or blanked. A binary frame
+ *  comes back as 0 and 255 and a gray frame as its levels. The step lit right
+ *  now is not counted yet.
+ *  @param sim The simulator
+ *  @param panel The panel
+ *  @param pixels Where to put numRows * rowBits bytes, [row][column]
+ */
+void ledmsg_sim_image(struct ledmsg_sim *sim, unsigned int panel, u8 *pixels) {
+    const struct ledmsg_bus *bus = &sim->bus;
+    const u64 *lit = sim->litNs + panel * bus->numRows * bus->rowBits;
+    u64 rowNs = sim->totalNs / bus->numRows;
+    unsigned int r, c;
+
+    for (r = 0; r < bus->numRows; ++r)
+        for (c = 0; c < bus->rowBits; ++c, ++lit)
+            *pixels++ = rowNs ? min_t(u64, (*lit * 255 + rowNs / 2) / rowNs, 255) : 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file   ledmsg_sim.h
+ * @author David Good
+ * @date   16 October 2026
+ * @version 0.1
+ * @brief  Userspace simulator of a ledmsgchar bus: the scan engine of
+ * ledmsg_core.c driving a mock GPIO backend instead of pins. The mock does
+ * the same array writes as the gpiod backend, records every pin edge, and
+ * emulates the panels' shift registers, latches and row drivers so the image
+ * they would show can be reconstructed from how long each LED was lit.
+ */
+#ifndef LEDMSG_SIM_H
+#define LEDMSG_SIM_H
+
+#include "ledmsg_core.h"
+
+/** @brief Pins of the mock bus, data line k of panel k comes first */
+enum {
+    SIM_PIN_CLK = LEDMSG_MAX_PANELS,
+    SIM_PIN_STB,
+    SIM_PIN_BLK,
+    SIM_PIN_A0,
+    SIM_PIN_A1,
+    SIM_PIN_A2,
+    SIM_NUM_PINS
+};
+
+/** @brief A recorded pin edge */
+struct ledmsg_sim_edge {
+    u64 timeNs;                         ///< Simulated time of the edge
+    u8 pin;                             ///< SIM_PIN_* or a data line
+    u8 level;                           ///< Level after the edge
+};
+
+/** @brief A simulated bus and the panels on it */
+struct ledmsg_sim {
+    struct ledmsg_bus bus;              ///< The bus, scanned by ledmsg_sim_run()
+    u64 nowNs;                          ///< Simulated time, advanced by the row on times
+    u64 rowPeriodNs;                    ///< Row period the scan runs with
+    u64 onTimeNs;                       ///< On time of the step latched last
+
+    /* Counters, cleared by ledmsg_sim_reset() */
+    u64 gpioOps;                        ///< Array writes, each one register write per bank on real hardware
+    u64 edges;                          ///< Pin edges
+    u64 rowsShifted;                    ///< write_row calls
+    u64 rowsLatched;                    ///< latch_row calls
+    u64 blanks;                         ///< blank calls
+    u64 wakeups;                        ///< Steps latched at their deadline, the rest are slept through
+
+    /* Edge log, kept when edgeLogSize is set by ledmsg_sim_record() */
+    struct ledmsg_sim_edge *edgeLog;    ///< Oldest edges first
+    size_t edgeLogSize;                 ///< Room in edgeLog
+    size_t edgeLogCount;                ///< Edges in edgeLog, stops growing once full
+
+    /* Emulated hardware */
+    u32 levels;                         ///< Pin levels, bit n for pin n
+    u8 *shiftReg;                       ///< [panel][rowBits] ring of the bits shifted in
+    unsigned int shiftHead;             ///< Oldest bit of each shift register ring
+    u8 *latch;                          ///< [panel][rowBits] output latches, leftmost pixel first
+    u64 lastAccountNs;                  ///< When lit time was last added up
+    u64 *litNs;                         ///< [panel][row][col] time each LED was lit
+    u64 totalNs;                        ///< Time accounted for since ledmsg_sim_reset()
+};
+
+int  ledmsg_sim_init(struct ledmsg_sim *sim, unsigned int rows, unsigned int rowBytes,
+                     unsigned int canvasWidth, unsigned int canvasHeight, unsigned int numPanels);
+void ledmsg_sim_free(struct ledmsg_sim *sim);
+int  ledmsg_sim_record(struct ledmsg_sim *sim, size_t maxEdges);
+void ledmsg_sim_reset(struct ledmsg_sim *sim);
+void ledmsg_sim_run(struct ledmsg_sim *sim, unsigned long steps);
+void ledmsg_sim_image(struct ledmsg_sim *sim, unsigned int panel, u8 *pixels);
+
+#endif /* LEDMSG_SIM_H */
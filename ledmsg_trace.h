@@ -0,0 +1,57 @@
+/**
+ * @file   ledmsg_trace.h
+ * @author David Good
+ * @date   16 October 2026
+ * @version 0.1
+ * @brief  Tracepoints of the ledmsgchar LKM, under events/ledmsg in tracefs.
+ * A disabled tracepoint costs a predicted branch, so they stay compiled in.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ledmsg
+
+#if !defined(LEDMSG_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define LEDMSG_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/** @brief A frame was handed to update_row by write(), LEDMSG_IOC_FLIP or the like */
+TRACE_EVENT(ledmsg_frame_commit,
+    TP_PROTO(unsigned int panel, unsigned int seq, bool overwritten),
+    TP_ARGS(panel, seq, overwritten),
+    TP_STRUCT__entry(
+        __field(unsigned int, panel)
+        __field(unsigned int, seq)
+        __field(bool, overwritten)
+    ),
+    TP_fast_assign(
+        __entry->panel = panel;
+        __entry->seq = seq;
+        __entry->overwritten = overwritten;
+    ),
+    TP_printk("panel=%u seq=%u overwritten=%d", __entry->panel, __entry->seq, __entry->overwritten)
+);
+
+/** @brief update_row latched a row, lateNs after its deadline */
+TRACE_EVENT(ledmsg_row_latch,
+    TP_PROTO(unsigned int row, unsigned int plane, s64 lateNs),
+    TP_ARGS(row, plane, lateNs),
+    TP_STRUCT__entry(
+        __field(unsigned int, row)
+        __field(unsigned int, plane)
+        __field(s64, lateNs)
+    ),
+    TP_fast_assign(
+        __entry->row = row;
+        __entry->plane = plane;
+        __entry->lateNs = lateNs;
+    ),
+    TP_printk("row=%u plane=%u late_ns=%lld", __entry->row, __entry->plane, __entry->lateNs)
+);
+
+#endif /* LEDMSG_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ledmsg_trace
+#include <trace/define_trace.h>
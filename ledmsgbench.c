@@ -0,0 +1,456 @@
+/**
+ * @file   ledmsgbench.c
+ * @author David Good
+ * @date   16 October 2026
+ * @version 0.1
+ * @brief  Benchmark of the ledmsgchar scan engine on the userspace simulator,
+ * so changes to the driver can be measured without a BeagleBone. Reports
+ * frames per second decoded and compiled, the hex decoder against the old
+ * lookup table one, ns per row shifted, GPIO operations per frame and the
+ * refresh rate the scan would run at and layer updates per second, then
+ * checks the hex decoder, the images the simulated panels showed, with and
+ * without a layer and after a rejected write to it, and snapshots of them,
+ * and the text renderer against the font. Exits non-zero if any is wrong.
+ * Build and run with "make bench".
+ */
+
+#include <getopt.h>
+#include "ledmsg_sim.h"
+
+static unsigned int rows = LEDMSG_NUM_ROWS;         ///< -r, rows per panel
+static unsigned int rowBytes = LEDMSG_NUM_ROW_BYTES; ///< -b, bytes per panel row
+static unsigned int numPanels = 1;                  ///< -p, panels on the bus
+static unsigned int grayBits = 4;                   ///< -g, bit-planes of the gray frames
+static unsigned long iterations = 20000;            ///< -n, frames decoded and scanned per test
+static u64 rowPeriodNs = 2000000;                   ///< -t, row period of the simulated scan
+static u64 gpioOpNs = 0;                            ///< -o, cost of a GPIO write on the target, added to the shift time
+static bool skipRepeats;                            ///< -s, run with the skipRepeats idle policy
+
+/** @brief Internal: Seconds since some fixed point, for timing the tests */
+static double now_sec(void) {
+    return ktime_get() / 1e9;
+}
+
+/** @brief Internal: Fills a buffer with a repeatable pattern
+ *  @param buf The buffer
+ *  @param len Its size
+ *  @param seed Picks the pattern
+ */
+static void fill_pattern(u8 *buf, size_t len, unsigned int seed) {
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+}
+
+/** @brief Internal: The hex decoder the driver had before ledmsg_decode_hex(), for comparison
+ *  Looks each character up in a table without checking it, so some non hex
+ *  characters decode to something.
+ *  @param val A pointer to two ASCII bytes
+ *  @return The byte value
+ */
+static u8 ascii2byte(const char *val) {
+    static const u8 hexLookup[] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, // 01234567
+        0x08, 0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 89:;<=>?
+        0x00, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x00, // @ABCDEFG
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // HIJKLMNO
+    };
+
+    return (hexLookup[(val[0] & 0x1F) ^ 0x10] << 4) | hexLookup[(val[1] & 0x1F) ^ 0x10];
+}
+
+/** @brief Internal: Decodes hex with ascii2byte(), like the driver used to
+ *  @param hex numBytes * 2 characters
+ *  @param data Where to put the numBytes bytes
+ *  @param numBytes Bytes to decode
+ */
+static void decode_hex_lookup(const char *hex, u8 *data, size_t numBytes) {
+    for (; numBytes; --numBytes, hex += 2)
+        *data++ = ascii2byte(hex);
+}
+
+/** @brief Internal: Checks ledmsg_decode_hex() against decode_hex_lookup() and on bad characters
+ *  Every length up to numBytes is decoded, so each tail the word loop leaves
+ *  is covered, and a bad character is tried at every position.
+ *  @param hex numBytes * 2 valid hex characters, upper and lower case
+ *  @param numBytes Bytes they hold
+ *  @return The number of decodes that came out wrong
+ */
+static unsigned int check_decode_hex(const char *hex, size_t numBytes) {
+    static const char badChars[] = { '/', ':', '@', 'G', '`', 'g', ' ', '\0', (char)0xb0, (char)0xe1 };
+    char *bad = malloc(numBytes * 2);
+    u8 *expect = malloc(numBytes);
+    u8 *data = malloc(numBytes);
+    unsigned int errors = 0;
+    size_t len, i, c;
+
+    for (len = 0; len <= numBytes; ++len) {
+        decode_hex_lookup(hex, expect, len);
+        if (ledmsg_decode_hex(hex, data, len) || memcmp(data, expect, len))
+            ++errors;
+    }
+    memcpy(bad, hex, numBytes * 2);
+    for (i = 0; i < numBytes * 2; ++i) {
+        for (c = 0; c < sizeof(badChars); ++c) {
+            bad[i] = badChars[c];
+            if (ledmsg_decode_hex(bad, data, numBytes) != -EINVAL)
+                ++errors;
+        }
+        bad[i] = hex[i];
+    }
+    free(bad);
+    free(expect);
+    free(data);
+    return errors;
+}
+
+/** @brief Internal: Publishes the back buffer of a panel and scans until the panel shows it
+ *  Leaves the scan at the start of a frame, with row 0 of the new frame lit.
+ *  @param sim The simulator
+ *  @param panel The panel, its back buffer compiled
+ */
+static void show_back(struct ledmsg_sim *sim, struct ledmsg_panel *panel) {
+    struct ledmsg_bus *bus = &sim->bus;
+
+    ledmsg_publish_back(panel);
+    do
+        ledmsg_sim_run(sim, 1);
+    while (ledmsg_frame_pending(panel) || bus->row || bus->plane);
+}
+
+/** @brief Internal: Compares what every panel showed with their canvases
+ *  @param sim The simulator, reset right before the frame was scanned
+ *  @param canvas Per panel, the canvas pixels as [row][column] levels 0-255
+ *  @param numPlanes Bit-planes the frames were shown with
+ *  @return The number of pixels that came out wrong
+ */
+static unsigned int check_image(struct ledmsg_sim *sim, u8 *const *canvas, unsigned int numPlanes) {
+    const struct ledmsg_bus *bus = &sim->bus;
+    unsigned int levels = (1U << numPlanes) - 1;
+    unsigned int k, r, c, expect, bad = 0;
+    u8 *shown = malloc(bus->numRows * bus->rowBits);
+
+    for (k = 0; k < bus->numPanels; ++k) {
+        ledmsg_sim_image(sim, k, shown);
+        for (r = 0; r < bus->numRows; ++r)
+            for (c = 0; c < bus->rowBits; ++c) {
+                expect = canvas[k][r * bus->canvasWidth + c] >> (8 - numPlanes);
+                expect = (expect * 255 + levels / 2) / levels;
+                if (abs((int)shown[r * bus->rowBits + c] - (int)expect) > 1)
+                    ++bad;
+            }
+    }
+    free(shown);
+    return bad;
+}
+
+/** @brief Internal: Checks ledmsg_render_text() against the font table
+ *  A line of text is drawn at every column offset from -7 to 16, so glyphs
+ *  start at every bit of a byte and hang over the left edge, plain and
+ *  inverted.
+ *  @param bus The bus giving the canvas size
+ *  @return The number of pixels drawn wrong
+ */
+static unsigned int check_text(const struct ledmsg_bus *bus) {
+    static const char line[] = "HHHHH#W@";
+    struct ledmsg_text attr = { 0 };
+    struct ledmsg_frame frame = { .data = malloc(bus->canvasBytes) };
+    unsigned int i, c, r, bad = 0;
+    bool lit, shown;
+    int x, px;
+
+    for (attr.flags = 0; attr.flags <= LEDMSG_TEXT_INVERT; attr.flags += LEDMSG_TEXT_INVERT) {
+        for (x = -7; x <= 16; ++x) {
+            attr.x = x;
+            ledmsg_render_text(bus, &attr, (const u8 *)line, sizeof(line) - 1, &frame);
+            for (r = 0; r < bus->canvasHeight && r < LEDMSG_FONT_HEIGHT; ++r)
+                for (px = 0; px < (int)bus->canvasWidth; ++px) {
+                    i = (px - x) / LEDMSG_FONT_ADVANCE;
+                    c = (px - x) % LEDMSG_FONT_ADVANCE;
+                    lit = px >= x && i < sizeof(line) - 1 && c < LEDMSG_FONT_WIDTH &&
+                          (ledmsg_font_columns(line[i])[c] & (1 << r));
+                    shown = frame.data[r * bus->canvasRowBytes + px / 8] & (0x80 >> (px % 8));
+                    if (shown != (lit != !!(attr.flags & LEDMSG_TEXT_INVERT)))
+                        ++bad;
+                }
+        }
+    }
+    free(frame.data);
+    return bad;
+}
+
+int main(int argc, char **argv) {
+    struct ledmsg_sim sim = { 0 };
+    struct ledmsg_bus *bus = &sim.bus;
+    struct ledmsg_panel *panel;
+    struct ledmsg_frame *frame;
+    const struct ledmsg_frame *shown;
+    u8 *gray[LEDMSG_MAX_PANELS] = { 0 };
+    u8 *expect[LEDMSG_MAX_PANELS];
+    u8 *layered;
+    struct ledmsg_panel_layer *layer;
+    char clock[] = "12:34";
+    u8 *snapshot;
+    struct ledmsg_text text = { .flags = LEDMSG_TEXT_CENTER };
+    unsigned long blankSteps, repeatSteps;
+    char *hex;
+    u8 *decoded;
+    double start, decodeSec, lookupSec, layerSec, graySec, rowSec, scanSec, shiftNs, stepNs, refreshHz;
+    unsigned long steps, i;
+    unsigned int k, r, bad, hexBad;
+    int opt, ret = 1;
+
+    while ((opt = getopt(argc, argv, "r:b:p:g:n:t:o:s")) != -1) {
+        switch (opt) {
+        case 'r': rows = strtoul(optarg, NULL, 0); break;
+        case 'b': rowBytes = strtoul(optarg, NULL, 0); break;
+        case 'p': numPanels = strtoul(optarg, NULL, 0); break;
+        case 'g': grayBits = clamp_t(unsigned int, strtoul(optarg, NULL, 0), 1, LEDMSG_MAX_GRAY_BITS); break;
+        case 'n': iterations = strtoul(optarg, NULL, 0) ?: 1; break;
+        case 't': rowPeriodNs = strtoull(optarg, NULL, 0); break;
+        case 'o': gpioOpNs = strtoull(optarg, NULL, 0); break;
+        case 's': skipRepeats = true; break;
+        default:
+            fprintf(stderr, "usage: %s [-r rows] [-b rowBytes] [-p panels] [-g grayBits] [-n frames]"
+                            " [-t rowPeriodNs] [-o gpioOpNs] [-s]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (ledmsg_sim_init(&sim, rows, rowBytes, 0, 0, numPanels)) {
+        fprintf(stderr, "failed to set up the simulator\n");
+        goto out;
+    }
+    sim.rowPeriodNs = rowPeriodNs;
+    bus->skipRepeats = skipRepeats;
+    printf("bus: %u panel(s) of %u rows x %u pixels, %u gray bits\n",
+           bus->numPanels, bus->numRows, bus->rowBits, grayBits);
+
+    hex = malloc(bus->canvasBytes * 2);
+    for (k = 0; k < bus->numPanels; ++k) {
+        gray[k] = malloc(bus->canvasBytes * 8);
+        fill_pattern(gray[k], bus->canvasBytes * 8, k + 1);
+    }
+    for (i = 0; i < bus->canvasBytes * 2; ++i)
+        hex[i] = "0123456789abcdef0123456789ABCDEF"[gray[0][i] & 0x1f];
+
+    // The hex decoder on its own, against the lookup table it replaced
+    decoded = malloc(bus->canvasBytes);
+    start = now_sec();
+    for (i = 0; i < iterations * 10; ++i)
+        ledmsg_decode_hex(hex, decoded, bus->canvasBytes);
+    decodeSec = now_sec() - start;
+    start = now_sec();
+    for (i = 0; i < iterations * 10; ++i)
+        decode_hex_lookup(hex, decoded, bus->canvasBytes);
+    lookupSec = now_sec() - start;
+    free(decoded);
+    printf("hex decode: %.1f ns per frame, %.1f ns with the lookup table\n",
+           decodeSec * 1e9 / (iterations * 10), lookupSec * 1e9 / (iterations * 10));
+    hexBad = check_decode_hex(hex, bus->canvasBytes);
+    printf("hex decode check: %s (%u bad decodes)\n", hexBad ? "FAILED" : "ok", hexBad);
+
+    // Decode and compile, what write() costs apart from the copy from userspace
+    panel = &bus->panels[0];
+    start = now_sec();
+    for (i = 0; i < iterations; ++i) {
+        frame = &panel->frames[panel->back];
+        frame->numPlanes = 1;
+        ledmsg_decode_hex(hex, frame->data, bus->canvasBytes);
+        ledmsg_commit_frame(panel, frame);
+        ledmsg_publish_back(panel);
+    }
+    decodeSec = now_sec() - start;
+
+    start = now_sec();
+    for (i = 0; i < iterations; ++i) {
+        frame = &panel->frames[panel->back];
+        frame->numPlanes = grayBits;
+        ledmsg_gray_to_planes(bus, gray[0], grayBits, frame->data, bus->canvasBytes);
+        ledmsg_commit_frame(panel, frame);
+        ledmsg_publish_back(panel);
+    }
+    graySec = now_sec() - start;
+    // One canvas row rewritten at a time, what pwrite() and LEDMSG_IOC_WRITE_RECT cost
+    start = now_sec();
+    for (i = 0; i < iterations; ++i) {
+        r = i % bus->canvasHeight;
+        frame = ledmsg_edit_back(panel, 0);
+        ledmsg_decode_hex(hex + r * bus->canvasRowBytes * 2, frame->data + r * bus->canvasRowBytes,
+                          bus->canvasRowBytes);
+        frame->dirtyRows |= BIT_ULL(r);
+        ledmsg_commit_rows(panel, frame);
+        ledmsg_publish_rows(panel, BIT_ULL(r));
+    }
+    rowSec = now_sec() - start;
+    printf("decode+compile: %.0f hex frames/s, %.0f gray frames/s, %.0f single row updates/s\n",
+           iterations / decodeSec, iterations / graySec, iterations / rowSec);
+
+    // Gray frames on every panel, shown then scanned for a while
+    for (k = 0; k < bus->numPanels; ++k) {
+        panel = &bus->panels[k];
+        frame = &panel->frames[panel->back];
+        frame->numPlanes = grayBits;
+        ledmsg_gray_to_planes(bus, gray[k], grayBits, frame->data, bus->canvasBytes);
+        ledmsg_commit_frame(panel, frame);
+        ledmsg_publish_back(panel);
+    }
+
+    // Then the top row of the last panel's canvas rewritten on its own
+    k = bus->numPanels - 1;
+    panel = &bus->panels[k];
+    fill_pattern(gray[k], bus->canvasWidth, 99);
+    frame = ledmsg_edit_back(panel, grayBits);
+    ledmsg_gray_to_planes(bus, gray[k], grayBits, frame->data, bus->canvasRowBytes);
+    frame->dirtyRows |= BIT_ULL(0);
+    ledmsg_commit_rows(panel, frame);
+    show_back(&sim, panel);
+    ledmsg_sim_reset(&sim);
+
+    steps = iterations * bus->numRows * bus->numPlanes;
+    start = now_sec();
+    ledmsg_sim_run(&sim, steps);
+    scanSec = now_sec() - start;
+
+    // The mock's own bookkeeping is counted in, so this is an upper bound for the core
+    shiftNs = scanSec * 1e9 / (sim.rowsShifted ?: 1);
+    stepNs = shiftNs + (double)sim.gpioOps / (sim.rowsShifted ?: 1) * gpioOpNs;
+    refreshHz = 1e9 / (bus->numRows * (rowPeriodNs > bus->numPlanes * stepNs ? rowPeriodNs : bus->numPlanes * stepNs));
+    printf("scan: %.1f ns per row shifted, %.1f GPIO ops and %.1f edges per frame\n",
+           shiftNs, (double)sim.gpioOps / iterations, (double)sim.edges / iterations);
+    printf("refresh: %.1f Hz at rowPeriodNs %llu, at most %.1f Hz when shift bound\n",
+           refreshHz, (unsigned long long)rowPeriodNs, 1e9 / (bus->numRows * bus->numPlanes * stepNs));
+
+    bad = check_image(&sim, gray, bus->numPlanes);
+    printf("image check: %s (%u bad pixels)\n", bad ? "FAILED" : "ok", bad);
+    ret = (bad || hexBad) ? 1 : 0;
+
+    // What read() would give for the last panel, the gray levels it was written with
+    snapshot = malloc(bus->canvasBytes * 8);
+    shown = ledmsg_shown_frame(panel);
+    ledmsg_planes_to_gray(bus, shown->composed, shown->numPlanes, snapshot);
+    for (i = 0, bad = 0; i < bus->canvasBytes * 8; ++i)
+        if (snapshot[i] >> (8 - grayBits) != gray[k][i] >> (8 - grayBits))
+            ++bad;
+    printf("snapshot check: %s (%u bad pixels)\n", bad ? "FAILED" : "ok", bad);
+    ret |= bad ? 1 : 0;
+    free(snapshot);
+
+    // Full brightness text on a gray frame, the mostly dark, mostly static case
+    for (k = 0; k < bus->numPanels; ++k) {
+        panel = &bus->panels[k];
+        frame = &panel->frames[panel->back];
+        ledmsg_render_text(bus, &text, (const u8 *)"12:34", 5, frame);
+        ledmsg_planes_to_gray(bus, frame->data, frame->numPlanes, gray[k]);
+        frame->numPlanes = grayBits;
+        ledmsg_gray_to_planes(bus, gray[k], grayBits, frame->data, bus->canvasBytes);
+        ledmsg_commit_frame(panel, frame);
+        if (k + 1 < bus->numPanels)
+            ledmsg_publish_back(panel);
+    }
+    show_back(&sim, panel);
+    ledmsg_sim_reset(&sim);
+    blankSteps = bus->stats.blankSteps;
+    repeatSteps = bus->stats.repeatSteps;
+    ledmsg_sim_run(&sim, iterations * bus->numRows * bus->numPlanes);
+    printf("text: %.1f GPIO ops, %.1f rows shifted and %.1f wakeups per frame, %.1f blank and %.1f repeated steps\n",
+           (double)sim.gpioOps / iterations, (double)sim.rowsShifted / iterations,
+           (double)sim.wakeups / iterations, (double)(bus->stats.blankSteps - blankSteps) / iterations,
+           (double)(bus->stats.repeatSteps - repeatSteps) / iterations);
+    bad = check_image(&sim, gray, bus->numPlanes);
+    printf("text image check: %s (%u bad pixels)\n", bad ? "FAILED" : "ok", bad);
+    ret |= bad ? 1 : 0;
+    bad = check_text(bus);
+    printf("font check: %s (%u bad pixels)\n", bad ? "FAILED" : "ok", bad);
+    ret |= bad ? 1 : 0;
+
+    // A text layer over the gray frame of the last panel, a clock over a picture
+    for (k = 0; k < bus->numPanels; ++k) {
+        panel = &bus->panels[k];
+        fill_pattern(gray[k], bus->canvasBytes * 8, k + 1);
+        frame = &panel->frames[panel->back];
+        frame->numPlanes = grayBits;
+        ledmsg_gray_to_planes(bus, gray[k], grayBits, frame->data, bus->canvasBytes);
+        ledmsg_commit_frame(panel, frame);
+        ledmsg_publish_back(panel);
+    }
+    layer = ledmsg_layer_alloc(panel);
+    layer->x = (bus->canvasWidth > 8) ? 8 : 0;
+    layer->y = 1 % bus->canvasHeight;
+    layer->z = 1;
+    ledmsg_layer_place(panel, layer);
+    start = now_sec();
+    for (i = 0; i <= iterations; ++i) {
+        clock[4] = '0' + i % 10;
+        ledmsg_render_text(bus, &text, (const u8 *)clock, 5, ledmsg_edit_layer(panel, layer, 0));
+        ledmsg_commit_layer(panel, layer);
+        frame = ledmsg_edit_back(panel, 0);
+        frame->dirtyRows |= LEDMSG_ALL_ROWS;
+        ledmsg_commit_rows(panel, frame);
+        if (i < iterations)
+            ledmsg_publish_rows(panel, LEDMSG_ALL_ROWS);
+    }
+    layerSec = now_sec() - start;
+    show_back(&sim, panel);
+    ledmsg_sim_reset(&sim);
+    ledmsg_sim_run(&sim, bus->numRows * bus->numPlanes);
+
+    // Expected: the lit pixels of the layer at full brightness, moved to x, y
+    layered = malloc(bus->canvasBytes * 8);
+    snapshot = malloc(bus->canvasBytes * 8);
+    memcpy(layered, gray[k - 1], bus->canvasBytes * 8);
+    ledmsg_planes_to_gray(bus, layer->frame.data, layer->frame.numPlanes, snapshot);
+    for (r = 0; r < bus->canvasHeight; ++r)
+        for (i = 0; i < bus->canvasWidth; ++i)
+            if (snapshot[r * bus->canvasWidth + i])
+                layered[(r + layer->y) % bus->canvasHeight * bus->canvasWidth + (i + layer->x) % bus->canvasWidth] = 255;
+    expect[k - 1] = layered;
+    for (k = 0; k + 1 < bus->numPanels; ++k)
+        expect[k] = gray[k];
+    bad = check_image(&sim, expect, bus->numPlanes);
+    shown = ledmsg_shown_frame(panel);
+    ledmsg_planes_to_gray(bus, shown->composed, shown->numPlanes, snapshot);
+    for (i = 0; i < bus->canvasBytes * 8; ++i)
+        if (snapshot[i] >> (8 - grayBits) != layered[i] >> (8 - grayBits))
+            ++bad;
+    printf("layer: %.0f layer updates/s composited and compiled\n", iterations / layerSec);
+    printf("layer image check: %s (%u bad pixels)\n", bad ? "FAILED" : "ok", bad);
+    ret |= bad ? 1 : 0;
+
+    // A hex write the driver rejects half way through must leave the layer as it was
+    memset(hex, '0', bus->canvasBytes * 2);
+    hex[bus->canvasBytes] = 'x';
+    bad = ledmsg_decode_hex(hex, ledmsg_edit_layer(panel, layer, 0)->data, bus->canvasBytes) != -EINVAL;
+    frame = ledmsg_edit_back(panel, 0);
+    frame->dirtyRows |= LEDMSG_ALL_ROWS;
+    ledmsg_commit_rows(panel, frame);
+    show_back(&sim, panel);
+    ledmsg_sim_reset(&sim);
+    ledmsg_sim_run(&sim, bus->numRows * bus->numPlanes);
+    bad += check_image(&sim, expect, bus->numPlanes);
+    printf("layer bad write check: %s (%u bad pixels)\n", bad ? "FAILED" : "ok", bad);
+    ret |= bad ? 1 : 0;
+
+    // Taking the layer away brings the frame below back
+    ledmsg_layer_free(layer);
+    frame = ledmsg_edit_back(panel, 0);
+    ledmsg_commit_rows(panel, frame);
+    show_back(&sim, panel);
+    ledmsg_sim_reset(&sim);
+    ledmsg_sim_run(&sim, bus->numRows * bus->numPlanes);
+    bad = check_image(&sim, gray, bus->numPlanes);
+    printf("layer removal check: %s (%u bad pixels)\n", bad ? "FAILED" : "ok", bad);
+    ret |= bad ? 1 : 0;
+    free(layered);
+    free(snapshot);
+
+    free(hex);
+    for (k = 0; k < bus->numPanels; ++k)
+        free(gray[k]);
+out:
+    ledmsg_sim_free(&sim);
+    return ret;
+}
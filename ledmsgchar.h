@@ -0,0 +1,221 @@
+/**
+ * @file   ledmsgchar.h
+ * @author David Good
+ * @date   18 March 2016
+ * @version 0.1
+ * @brief  Interface shared by the ledmsgchar LKM and the user space programs
+ * that talk to /dev/ledmsgchar: frame geometry, frame formats and ioctls.
+ */
+#ifndef LEDMSGCHAR_H
+#define LEDMSGCHAR_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define LEDMSG_NUM_ROWS        8    ///< Rows of the standard panel, the panelRows default
+#define LEDMSG_NUM_ROW_BYTES   18   ///< Bytes of pixel data per row of the standard panel, MSB is the leftmost pixel
+#define LEDMSG_FRAME_BYTES     (LEDMSG_NUM_ROWS * LEDMSG_NUM_ROW_BYTES) ///< Size of a binary frame
+#define LEDMSG_HEX_FRAME_CHARS (LEDMSG_FRAME_BYTES * 2)                 ///< Size of a hex frame
+#define LEDMSG_NUM_COLS        (LEDMSG_NUM_ROW_BYTES * 8)                ///< Pixels per row
+#define LEDMSG_GRAY_FRAME_BYTES (LEDMSG_NUM_ROWS * LEDMSG_NUM_COLS)      ///< Size of a grayscale frame
+#define LEDMSG_MAX_GRAY_BITS   8    ///< Most bit-planes a grayscale frame can be shown with
+#define LEDMSG_MAX_ROW_BYTES   64   ///< Longest row the panelRowBytes module parameter allows
+#define LEDMSG_MAX_PANELS      8    ///< Most panels that can share a clock, each with its own data line
+#define LEDMSG_MAX_CANVAS_WIDTH  4096 ///< Widest canvas the canvasWidth module parameter allows
+#define LEDMSG_MAX_CANVAS_HEIGHT 64   ///< Tallest canvas the canvasHeight module parameter allows
+
+/** @brief Frame formats accepted by write()
+ *  The format is kept per open file and defaults to LEDMSG_FMT_HEX.
+ *
+ *  A write() of a whole frame at position 0 replaces the frame. A shorter
+ *  write(), or a pwrite() or lseek() to another position, rewrites just that
+ *  part of the newest frame and leaves the rest as it was. Positions count in
+ *  the units of the format and a partial write has to cover whole bytes of
+ *  the binary layout: an even number of hex characters, or runs of 8 gray
+ *  pixels. write() does not move the file position, so plain writes keep
+ *  landing at the same place. See also LEDMSG_IOC_WRITE_RECT.
+ *
+ *  writev() and pwritev() take a batch: every segment is handled as a write()
+ *  of its own at the same position, in order, without another writer getting
+ *  in between unless a segment waits for its frame slot in LEDMSG_WRITE_BLOCK
+ *  mode. Segments can be whole frames, texts or parts of a frame, and the
+ *  write mode applies to each one. The count returned covers the segments
+ *  done before the first that failed, so a short count tells where it stopped.
+ *
+ *  read() gives the frame the panel shows in the same format: a read at
+ *  position 0 takes a snapshot, later reads carry on through it and the end
+ *  of the frame reads as end of file. Reads do move the file position, so
+ *  use pread() on a file that is also written to.
+ *
+ *  A frame covers the whole canvas, which is the size of the panel unless the
+ *  driver was loaded with a larger canvasWidth/canvasHeight. The panel shows
+ *  the part of the canvas chosen with LEDMSG_IOC_SET_VIEWPORT. Sizes below
+ *  are for the standard panel and default canvas; see struct ledmsg_geometry
+ *  for the others.
+ */
+enum ledmsg_format {
+    LEDMSG_FMT_HEX    = 0,      ///< Two ASCII hex characters per byte, either case, row 0 first
+    LEDMSG_FMT_BINARY = 1,      ///< Raw bytes in the same [row][byte] layout as the hex format
+    LEDMSG_FMT_GRAY   = 2,      ///< One byte per pixel, [row][column], 0 is off and 255 is full on
+    LEDMSG_FMT_TEXT   = 3,      ///< UTF-8 text drawn by the driver, see struct ledmsg_text
+};
+
+/** @brief How write() and LEDMSG_IOC_FLIP behave while a frame is still pending
+ *  The driver triple buffers: one buffer is displayed, one holds the newest
+ *  frame not yet shown and one is the back buffer being filled. The mode is
+ *  kept per open file and defaults to LEDMSG_WRITE_BLOCK.
+ */
+enum ledmsg_write_mode {
+    LEDMSG_WRITE_BLOCK  = 0,    ///< Wait until the pending frame is shown, -EAGAIN with O_NONBLOCK
+    LEDMSG_WRITE_LATEST = 1,    ///< Never wait, a pending frame that was not shown yet is replaced
+};
+
+/** @brief Number of frame buffers that can be mapped with mmap()
+ *  Each frame buffer starts on its own page: buffer i is at offset
+ *  i * ledmsg_geometry.mmapStride and holds a binary frame. Userspace draws
+ *  into the back buffer reported by LEDMSG_IOC_GET_BACK and hands it over
+ *  with LEDMSG_IOC_FLIP. The buffer returned by the flip holds an older frame
+ *  and has to be redrawn completely.
+ *  If the flipping file's format is LEDMSG_FMT_GRAY the buffer instead holds
+ *  the grayBits module parameter's worth of binary frames, one per bit-plane,
+ *  least significant plane first.
+ */
+#define LEDMSG_MMAP_FRAMES     3
+
+/** @brief A batch of frames for LEDMSG_IOC_QUEUE
+ *  The driver copies and compiles all the frames up front, then update_row
+ *  steps through them on its own frame boundaries without waking anybody.
+ *  Queueing a batch replaces the one playing; writing or flipping a frame
+ *  stops it.
+ */
+struct ledmsg_queue {
+    __u64 frames;       ///< User pointer to count frames, back to back, in the file's format
+    __u64 durations;    ///< User pointer to count __u32 display times in us, 0 for NULL
+    __u32 count;        ///< Number of frames, at most the maxQueueFrames module parameter
+    __u32 flags;        ///< LEDMSG_QUEUE_* flags
+    __s64 startNs;      ///< CLOCK_MONOTONIC time to show the first frame at, 0 for right away
+};
+#define LEDMSG_QUEUE_LOOP      0x1  ///< Start over after the last frame instead of stopping
+
+/** @brief How LEDMSG_FMT_TEXT writes are drawn, set with LEDMSG_IOC_SET_TEXT
+ *  Each write() replaces the whole frame with its text, drawn in the built-in
+ *  5x7 font on a LEDMSG_FONT_ADVANCE pixel pitch. A newline starts a new line
+ *  LEDMSG_FONT_HEIGHT pixels down. Characters the font lacks are drawn as a
+ *  box and text running off the canvas is clipped. The attributes are kept
+ *  per open file and default to all zeros.
+ */
+struct ledmsg_text {
+    __s32 x;            ///< Left edge of the text in canvas pixels, or the offset from centre
+    __s32 y;            ///< Top edge of the first line in canvas pixels
+    __u32 flags;        ///< LEDMSG_TEXT_* flags
+};
+#define LEDMSG_TEXT_INVERT     0x1  ///< Dark text on a lit background
+#define LEDMSG_TEXT_CENTER     0x2  ///< Centre each line on the canvas, x then nudges it
+#define LEDMSG_MAX_TEXT_BYTES  1024 ///< Longest LEDMSG_FMT_TEXT write()
+#define LEDMSG_FONT_WIDTH      5    ///< Glyph width in pixels
+#define LEDMSG_FONT_HEIGHT     8    ///< Glyph height in pixels, including the blank bottom row
+#define LEDMSG_FONT_ADVANCE    6    ///< Pixels from one character to the next
+
+/** @brief Panel and canvas sizes, from LEDMSG_IOC_GET_GEOMETRY
+ *  Each panel is a /dev/ledmsgcharN of its own with its own frames, canvas
+ *  and viewport. All panels of the driver have the same sizes.
+ */
+struct ledmsg_geometry {
+    __u32 rows;         ///< Panel height in pixels
+    __u32 cols;         ///< Panel width in pixels
+    __u32 canvasWidth;  ///< Canvas width in pixels, a multiple of 8
+    __u32 canvasHeight; ///< Canvas height in pixels
+    __u32 mmapStride;   ///< Distance in bytes between the mmap()ed frame buffers
+    __u32 grayBits;     ///< Bit-planes LEDMSG_FMT_GRAY frames are split into right now
+    __u32 panel;        ///< N of the /dev/ledmsgcharN this came from
+    __u32 numPanels;    ///< Panels scanned together with this one
+};
+
+/** @brief Which part of the canvas the panel shows
+ *  x, y is the canvas pixel shown at the top left of the panel. The canvas
+ *  wraps around at its edges. With a speed set, update_row moves the viewport
+ *  on its own at every frame boundary, so scrolling costs userspace nothing.
+ */
+struct ledmsg_viewport {
+    __s32 x;            ///< Left edge, in canvas pixels
+    __s32 y;            ///< Top edge, in canvas pixels
+    __s32 dxPerSec;     ///< Horizontal scroll speed in pixels per second, 0 to stay put, at most 65536
+    __s32 dyPerSec;     ///< Vertical scroll speed in pixels per second, 0 to stay put, at most 65536
+};
+
+/** @brief A rectangle of the canvas for LEDMSG_IOC_WRITE_RECT
+ *  Rewrites the rectangle in the newest frame and shows the result; the rest
+ *  of the frame stays as it was and only the rows touched are recompiled.
+ *  Rows of data are in the file's format, which cannot be LEDMSG_FMT_TEXT.
+ *  The rectangle has to lie within the canvas.
+ */
+struct ledmsg_rect {
+    __u64 data;         ///< User pointer to height rows of pixels
+    __u32 x;            ///< Left edge in canvas pixels, a multiple of 8
+    __u32 y;            ///< Top edge in canvas pixels
+    __u32 width;        ///< Width in pixels, a multiple of 8
+    __u32 height;       ///< Height in pixels
+    __u32 pitch;        ///< Bytes from one row of data to the next, 0 if they are back to back
+    __u32 reserved;     ///< Must be 0
+};
+
+/** @brief A snapshot of the frame a panel shows, from LEDMSG_IOC_SNAPSHOT
+ *  The snapshot is in the file's format, like a read() at position 0 gives.
+ *  Binary and hex snapshots hold the most significant bit-plane of a gray
+ *  frame, and a text file gets hex. Every frame written, flipped or queued
+ *  gets the next sequence number, so a poller can tell whether anything
+ *  changed without copying the frame.
+ */
+struct ledmsg_snapshot {
+    __u64 data;         ///< User pointer to room for a frame in the file's format
+    __u64 seq;          ///< In: with LEDMSG_SNAPSHOT_IF_CHANGED, the frame already seen. Out: the frame shown
+    __u32 size;         ///< In: room at data, at least a frame. Out: bytes copied there
+    __u32 flags;        ///< In: LEDMSG_SNAPSHOT_IF_CHANGED. Out: LEDMSG_SNAPSHOT_UNCHANGED
+};
+#define LEDMSG_SNAPSHOT_IF_CHANGED 0x1  ///< Copy nothing if the frame shown is still seq
+#define LEDMSG_SNAPSHOT_UNCHANGED  0x2  ///< Set on return when nothing was copied for that reason
+
+/** @brief A layer of the panel's own for this file, set with LEDMSG_IOC_SET_LAYER
+ *  Once a file has a layer, its writes go to the layer instead of the frame,
+ *  so several producers can each keep a part of the sign up to date without
+ *  knowing about each other. The frame written by files without a layer is at
+ *  the bottom, the layers are stacked on it by z and the driver composites
+ *  the rows that changed each time one of them is written. A layer is a
+ *  canvas in the file's format, placed with its top left corner at x, y and
+ *  wrapping around the canvas edges. Its lit pixels cover what is below,
+ *  unless a mask or LEDMSG_LAYER_OPAQUE says otherwise. It is shown with as
+ *  many bit-planes as the frame below it, and frames played by
+ *  LEDMSG_IOC_QUEUE are shown without the layers. Closing the file removes
+ *  its layer.
+ */
+struct ledmsg_layer {
+    __s32 z;            ///< Stacking order, higher is on top, ties go to the layer set last
+    __u32 x;            ///< Canvas column of the left edge, a multiple of 8
+    __u32 y;            ///< Canvas row of the top edge
+    __u32 flags;        ///< LEDMSG_LAYER_* flags
+    __u64 mask;         ///< User pointer to a binary frame whose set pixels cover what is below, 0 for none. Reads back as 0
+};
+#define LEDMSG_LAYER_ON        0x1  ///< Give the file a layer, clear to remove it and write the frame again
+#define LEDMSG_LAYER_HIDDEN    0x2  ///< Keep the layer but don't show it
+#define LEDMSG_LAYER_OPAQUE    0x4  ///< Dark pixels cover what is below too, when no mask is given
+
+#define LEDMSG_IOC_MAGIC      'L'
+#define LEDMSG_IOC_SET_FORMAT _IOW(LEDMSG_IOC_MAGIC, 1, int)  ///< Select the write() frame format
+#define LEDMSG_IOC_GET_FORMAT _IOR(LEDMSG_IOC_MAGIC, 2, int)  ///< Read back the write() frame format
+#define LEDMSG_IOC_GET_BACK   _IOR(LEDMSG_IOC_MAGIC, 3, int)  ///< Index of the mmap()ed buffer to draw into
+#define LEDMSG_IOC_FLIP       _IOR(LEDMSG_IOC_MAGIC, 4, int)  ///< Show the back buffer, returns the new back index
+#define LEDMSG_IOC_SET_WRITE_MODE _IOW(LEDMSG_IOC_MAGIC, 5, int)  ///< Select an enum ledmsg_write_mode
+#define LEDMSG_IOC_GET_WRITE_MODE _IOR(LEDMSG_IOC_MAGIC, 6, int)  ///< Read back the write mode
+#define LEDMSG_IOC_QUEUE      _IOW(LEDMSG_IOC_MAGIC, 7, struct ledmsg_queue) ///< Play a batch of frames
+#define LEDMSG_IOC_QUEUE_STOP _IO(LEDMSG_IOC_MAGIC, 8)    ///< Stop the batch, the last written frame comes back
+#define LEDMSG_IOC_GET_GEOMETRY _IOR(LEDMSG_IOC_MAGIC, 9, struct ledmsg_geometry)  ///< Panel and canvas sizes
+#define LEDMSG_IOC_SET_VIEWPORT _IOW(LEDMSG_IOC_MAGIC, 10, struct ledmsg_viewport) ///< Move or scroll the viewport
+#define LEDMSG_IOC_GET_VIEWPORT _IOR(LEDMSG_IOC_MAGIC, 11, struct ledmsg_viewport) ///< Where the viewport is now
+#define LEDMSG_IOC_SET_TEXT   _IOW(LEDMSG_IOC_MAGIC, 12, struct ledmsg_text) ///< Set this file's text attributes
+#define LEDMSG_IOC_GET_TEXT   _IOR(LEDMSG_IOC_MAGIC, 13, struct ledmsg_text) ///< Read back the text attributes
+#define LEDMSG_IOC_WRITE_RECT _IOW(LEDMSG_IOC_MAGIC, 14, struct ledmsg_rect) ///< Rewrite part of the frame
+#define LEDMSG_IOC_SNAPSHOT   _IOWR(LEDMSG_IOC_MAGIC, 15, struct ledmsg_snapshot) ///< Copy out the frame shown
+#define LEDMSG_IOC_SET_LAYER  _IOW(LEDMSG_IOC_MAGIC, 16, struct ledmsg_layer) ///< Add, move or remove this file's layer
+#define LEDMSG_IOC_GET_LAYER  _IOR(LEDMSG_IOC_MAGIC, 17, struct ledmsg_layer) ///< Read back this file's layer
+
+#endif /* LEDMSGCHAR_H */
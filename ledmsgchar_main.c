@@ -0,0 +1,1754 @@
+/**
+ * @file   ledmsgchar_main.c
+ * @author David Good
+ * @date   18 March 2016
+ * @version 0.1
+ * @brief   A character driver for a multiplexed LED message board.
+ * This module maps each panel to /dev/ledmsgcharN. This file is the module
+ * glue: parameters, GPIO and SPI backends, the scan thread and the file
+ * operations. The scan engine itself is in ledmsg_core.c.
+ * Code originally based on examples by Derek Molloy.
+ * @see http://www.derekmolloy.ie/ for great LKM examples.
+ */
+
+#include <linux/init.h>           // Macros used to mark up functions e.g. __init __exit
+#include <linux/module.h>         // Core header for loading LKMs into the kernel
+#include <linux/moduleparam.h>
+#include <linux/device.h>         // Header to support the kernel Driver Model
+#include <linux/kernel.h>         // Contains types, macros, functions for the kernel
+#include <linux/fs.h>             // Header for the Linux file system support
+#include <linux/uio.h>            // Required for the iov_iter of writev()
+#include <linux/gpio.h>           // Required for the GPIO functions
+#include <linux/gpio/consumer.h>  // Required for the batched gpiod array functions
+#include <linux/spi/spi.h>        // Required for the SPI output backend
+#include <linux/kobject.h>        // Using kobjects for the sysfs bindings
+#include <asm/uaccess.h>          // Required for the copy to user function
+#include <linux/kthread.h>        // Using kthreads for row scanning
+#include <linux/delay.h>          // Needed for msleep() function
+#include <linux/hrtimer.h>        // Row deadlines are slept on with high resolution timers
+#include <linux/ktime.h>          // Required for ktime_get() and friends
+#include <linux/sched.h>          // Required to make the scan thread real time
+#include <linux/types.h>          // Required for u8 type
+#include <linux/slab.h>           // Required for kzalloc() of the per file state
+#include <linux/mm.h>             // Required for remap_pfn_range() of the frame buffers
+#include <linux/wait.h>           // Wait queue used to signal that a frame was taken
+#include <linux/mutex.h>          // Serializes writers on the back buffer
+#include <linux/atomic.h>         // Lock free handoff of frame buffers to update_row
+#include <linux/poll.h>           // Required for poll() support
+#include <linux/spinlock.h>       // Guards the playlist handoff to update_row
+#include <linux/list.h>           // Retired playlists waiting to be freed
+#include <linux/debugfs.h>        // Statistics under /sys/kernel/debug/ledmsgchar
+#include <linux/seq_file.h>       // Required to print the statistics
+#include "ledmsg_core.h"           // Frames, panels, buses and the scan engine
+#define CREATE_TRACE_POINTS
+#include "ledmsg_trace.h"         // Tracepoints on frame commit and row latch
+
+#define  DEVICE_NAME "ledmsgchar" ///< The devices will appear at /dev/ledmsgcharN using this value
+#define  CLASS_NAME  "ledmsg"     ///< The device class -- this is a character device driver
+
+MODULE_LICENSE("GPL");            ///< The license type -- this affects available functionality
+MODULE_AUTHOR("David Good");      ///< The author -- visible when you use modinfo
+MODULE_DESCRIPTION("Multiplexed LED display driver");  ///< The description -- see modinfo
+MODULE_VERSION("0.1");            ///< A version number to inform users
+
+/* Character device related variables */
+static int    majorNumber;                  ///< Stores the device number -- determined automatically
+static int    numberOpens = 0;              ///< Counts the number of times the device is opened
+static struct class*  ledmsgcharClass  = NULL; ///< The device-driver class struct pointer
+static struct dentry* debugDir = NULL;      ///< The driver's debugfs directory
+
+// The prototype functions for the character driver -- must come before the struct definition
+static int     dev_open(struct inode *, struct file *);
+static int     dev_release(struct inode *, struct file *);
+static ssize_t dev_read(struct file *, char *, size_t, loff_t *);
+static ssize_t dev_write(struct file *, const char *, size_t, loff_t *);
+static ssize_t dev_write_iter(struct kiocb *, struct iov_iter *);
+static loff_t  dev_llseek(struct file *, loff_t, int);
+static long    dev_ioctl(struct file *, unsigned int, unsigned long);
+static int     dev_mmap(struct file *, struct vm_area_struct *);
+static __poll_t dev_poll(struct file *, poll_table *);
+
+/** @brief Devices are represented as file structure in the kernel. The file_operations structure from
+ *  /linux/fs.h lists the callback functions that you wish to associated with your file operations
+ *  using a C99 syntax structure. char devices usually implement open, read, write and release calls
+ */
+static struct file_operations fops =
+{
+   .owner = THIS_MODULE,
+   .open = dev_open,
+   .read = dev_read,
+   .write = dev_write,
+   .write_iter = dev_write_iter,
+   .llseek = dev_llseek,
+   .unlocked_ioctl = dev_ioctl,
+   .compat_ioctl = dev_ioctl,
+   .mmap = dev_mmap,
+   .poll = dev_poll,
+   .release = dev_release,
+};
+
+/** @brief State kept for each open file, hung off filep->private_data */
+struct ledmsg_file {
+    struct ledmsg_panel *panel;         ///< The panel behind the minor number that was opened
+    int format;                         ///< Frame format expected by dev_write(), see enum ledmsg_format
+    int writeMode;                      ///< What to do when a frame is still pending, see enum ledmsg_write_mode
+    struct ledmsg_text text;            ///< How LEDMSG_FMT_TEXT writes are drawn
+    u8 *snapshot;                       ///< Last snapshot of the shown frame, under the panel's writeLock
+    size_t snapshotLen;                 ///< Bytes in snapshot
+    u64 snapshotSeq;                    ///< Sequence number of the frame in snapshot
+    struct ledmsg_panel_layer *layer;   ///< Where writes go if not NULL, see struct ledmsg_layer; under writeLock
+};
+
+/* GPIO related vars */
+/* BeagleBone GPIO numbers are calculated by (portNum * 32) + portPosition
+ *   Example: GPIO1_30 = (1 * 32) + 30 = 62 */
+static unsigned int gpioA0 = 62;        ///< Row select bus A0 (LSB) (GPIO1_30)
+static unsigned int gpioA1 = 36;        ///< Row select bus A1       (GPIO1_4)
+static unsigned int gpioA2 = 32;        ///< Row select bus A2 (MSB) (GPIO1_0)
+static unsigned int gpioCLK = 48;       ///< Clock signal            (GPIO1_16)
+static int dataGpios[LEDMSG_MAX_PANELS] = { 49 }; ///< Data signal of each panel, D0 is GPIO1_17
+static int numDataGpios = 1;            ///< Entries given in dataGpios, one panel each
+module_param_array(dataGpios, int, &numDataGpios, S_IRUGO);
+MODULE_PARM_DESC(dataGpios, " Data GPIO of each panel sharing the clock and strobe lines, one /dev/ledmsgcharN each (default 49)");
+static unsigned int gpioSTB = 115;      ///< Data latch signal       (GPIO3_19)
+static unsigned int gpioBLK = 117;      ///< Pin to blank the sign, active high, use PWM for dimming
+static bool blank = 0;                  ///< Blank status of the sign, 1 for blank, 0 for not blank
+/* module_param(blank, bool, S_IRUGO);     ///< Param desc. S_IRUGO can be read/not changed */
+/* MODULE_PARAM_DESC(blank, " Blanks the sign if 1, un-blanks if 0"); */
+static unsigned int panelRows = LEDMSG_NUM_ROWS; ///< Multiplexed rows of each panel
+module_param(panelRows, uint, S_IRUGO);
+MODULE_PARM_DESC(panelRows, " Rows of each panel, 1 to 8 (default 8)");
+static unsigned int panelRowBytes = LEDMSG_NUM_ROW_BYTES; ///< Bytes shifted in per row of each panel
+module_param(panelRowBytes, uint, S_IRUGO);
+MODULE_PARM_DESC(panelRowBytes, " Bytes of pixels per row of each panel, chained panels add up (default 18)");
+static unsigned long rowPeriodNs = 2000000; ///< Display time for each row in ns
+module_param(rowPeriodNs, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rowPeriodNs, " Display time for each row in ns, can be changed at run time (default 2000000)");
+static unsigned long rowSlackNs = 20000; ///< How late a row deadline may fire so timers can be coalesced
+module_param(rowSlackNs, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rowSlackNs, " Allowed lateness of a row deadline in ns (default 20000)");
+#define MIN_ROW_PERIOD_NS 10000         ///< Floor for rowPeriodNs so a bad value can't hog the CPU
+static unsigned int grayBits = 4;       ///< Bit-planes LEDMSG_FMT_GRAY frames are shown with
+module_param(grayBits, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(grayBits, " Gray levels of LEDMSG_FMT_GRAY frames as bits per pixel, 1 to 8 (default 4)");
+static unsigned int canvasWidth;        ///< Width of the frames in pixels, 0 for the panel width
+module_param(canvasWidth, uint, S_IRUGO);
+MODULE_PARM_DESC(canvasWidth, " Canvas width in pixels, rounded up to a multiple of 8 (default: the panel width)");
+static unsigned int canvasHeight;       ///< Height of the frames in pixels, 0 for the panel height
+module_param(canvasHeight, uint, S_IRUGO);
+MODULE_PARM_DESC(canvasHeight, " Canvas height in pixels (default: the panel height)");
+static unsigned int maxQueueFrames = 256; ///< Longest batch LEDMSG_IOC_QUEUE accepts
+module_param(maxQueueFrames, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(maxQueueFrames, " Most frames LEDMSG_IOC_QUEUE takes in one batch (default 256)");
+static bool skipRepeats;                ///< Idle policy: don't shift in a row the shift registers hold already
+module_param(skipRepeats, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(skipRepeats, " Skip shifting rows that did not change and keep repeated steps lit, for mostly static signs (default 0)");
+static char *backend = "gpiod";         ///< Name of the output backend to use, see backends[]
+module_param(backend, charp, S_IRUGO);
+MODULE_PARM_DESC(backend, " Output backend: gpiod (batched, default), legacy (one pin at a time) or spi");
+/* SPI backend: row data goes out on the MOSI and SCK of an SPI controller wired
+ * to D0 and CLK. Without the sign on the bench it can be exercised by pointing
+ * spiBus at an spi-gpio controller whose sck and mosi lines come from a gpio-sim
+ * chip, then watching the lines through the gpio-sim sysfs attributes. */
+static int spiBus = 1;                  ///< SPI bus number, SPI1 on the BeagleBone
+module_param(spiBus, int, S_IRUGO);
+MODULE_PARM_DESC(spiBus, " SPI bus used by the spi backend (default 1)");
+static int spiChipSelect = 0;           ///< Chip select to claim on spiBus, unused by the sign
+module_param(spiChipSelect, int, S_IRUGO);
+MODULE_PARM_DESC(spiChipSelect, " SPI chip select claimed by the spi backend (default 0)");
+static unsigned int spiSpeedHz = 8000000; ///< SPI clock rate
+module_param(spiSpeedHz, uint, S_IRUGO);
+MODULE_PARM_DESC(spiSpeedHz, " SPI clock rate in Hz for the spi backend (default 8000000)");
+/* gpiod backend: the pins are grouped into two descriptor arrays so that every
+ * step of the shift and latch sequences is a single gpiod_set_raw_array_value()
+ * call. gpiolib turns that into one set_multiple() register write per GPIO bank. */
+enum { ROW_LINE_BLK, ROW_LINE_A0, ROW_LINE_A1, ROW_LINE_A2, ROW_LINE_STB, NUM_ROW_LINES };
+
+/** @brief The hardware behind the bus, reached through bus->priv by the backends
+ */
+struct ledmsg_hw {
+    struct gpio_desc *dataLines[LEDMSG_MAX_PANELS + 1]; ///< The data lines in panel order, then CLK
+    unsigned int numDataLines;          ///< numPanels + 1
+    struct gpio_desc *rowLines[NUM_ROW_LINES]; ///< BLK, A0-A2 and STB, indexed by ROW_LINE_*
+
+    struct spi_device *spiDev;          ///< Device claimed on spiBus/spiChipSelect
+    struct spi_transfer spiXfer;        ///< Reused for every row, only tx_buf changes
+    struct spi_message spiMsg;          ///< Holds spiXfer
+};
+static struct ledmsg_hw busHw;         ///< The lines and SPI device of bus
+static struct ledmsg_bus bus = { .priv = &busHw }; ///< The bus driven by this module
+static unsigned int gpiosHeld;         ///< GPIOs INIT_GPIO has requested, release_gpios() frees them in the same order
+
+#define INIT_GPIO(A) if (!gpio_is_valid((A))) {                 \
+        printk(KERN_INFO "LEDMSGCHAR: invalid GPIO " #A "\n");  \
+        result = -ENODEV;                                       \
+        goto error;                                             \
+    } else {                                                    \
+        result = gpio_request((A), "sysfs");                    \
+        if (result) {                                           \
+            printk(KERN_ALERT "LEDMSGCHAR: failed to request GPIO " #A "\n"); \
+            goto error;                                         \
+        }                                                       \
+        ++gpiosHeld;                                            \
+        gpio_direction_output((A), 0);                          \
+        gpio_export((A), false);                                \
+    }
+
+#define CLOSE_GPIO(A) if (gpiosHeld) {                          \
+        --gpiosHeld;                                            \
+        gpio_unexport((A));                                     \
+        gpio_free((A));                                         \
+    }
+
+/** @brief Internal: Frees the GPIOs INIT_GPIO requested, all of them or the
+ *  first ones if ledmsgchar_init() failed part way through
+ */
+static void release_gpios(void) {
+    unsigned int i;
+
+    if (!gpiosHeld)
+        return;
+    CLOSE_GPIO(gpioA0);
+    CLOSE_GPIO(gpioA1);
+    CLOSE_GPIO(gpioA2);
+    if (!bus.output->noDataGpios) {
+        CLOSE_GPIO(gpioCLK);
+        for (i = 0; i < bus.numPanels; ++i)
+            CLOSE_GPIO(dataGpios[i]);
+    }
+    CLOSE_GPIO(gpioSTB);
+    CLOSE_GPIO(gpioBLK);
+}
+
+/** @brief Internal: Writes a compiled row to the data chips one pin at a time
+ *
+ *  @param bus The bus to write to
+ *  @param stream bus->rowBits lane bitmaps, bit k for the data line of panel k
+ */
+static void legacy_write_row(struct ledmsg_bus *bus, const u8 *stream) {
+    unsigned int i, k;
+    for (i = 0; i < bus->rowBits; ++i) {
+        for (k = 0; k < bus->numPanels; ++k)
+            gpio_set_value(dataGpios[k], (stream[i] >> k) & 1);
+        gpio_set_value(gpioCLK, 1);
+        // delay some time to respect minimum clock pulse width
+        gpio_set_value(gpioCLK, 0);
+    }
+}
+
+/** @brief Internal: Blanks the display, switches to a row and latches its data one pin at a time
+ *
+ *  @param bus The bus to latch
+ *  @param rowNum The row whose data was just shifted in
+ */
+static void legacy_latch_row(struct ledmsg_bus *bus, unsigned int rowNum) {
+    gpio_set_value(gpioBLK, 1); // Blank the display while we change rows
+    // usleep(10);
+    (rowNum & 1) ? gpio_set_value(gpioA0, 1) : gpio_set_value(gpioA0, 0);
+    (rowNum & 2) ? gpio_set_value(gpioA1, 1) : gpio_set_value(gpioA1, 0);
+    (rowNum & 4) ? gpio_set_value(gpioA2, 1) : gpio_set_value(gpioA2, 0);
+    // Do we need to wait here for output drivers to fully turn off?
+    gpio_set_value(gpioSTB, 1);
+    // udelay(??); don't violate minimum pulse width time
+    gpio_set_value(gpioSTB, 0);
+    // Do we need to wait here for driver outputs to settle?
+    gpio_set_value(gpioBLK, 0); // Un-blank the display
+}
+
+/** @brief Internal: Turns the display off until the next latch
+ *  @param bus The bus to blank
+ */
+static void legacy_blank(struct ledmsg_bus *bus) {
+    gpio_set_value(gpioBLK, 1);
+}
+
+static const struct ledmsg_backend legacyBackend = {
+    .name = "legacy",
+    .streamScale = 8,
+    .parallel = true,
+    .compile_row = ledmsg_compile_levels,
+    .write_row = legacy_write_row,
+    .latch_row = legacy_latch_row,
+    .blank = legacy_blank,
+};
+
+/** @brief Internal: Looks up the descriptors of the row control GPIOs requested in ledmsgchar_init()
+ *  BLK is first in rowLines so its bank is written before the address bank.
+ *  @param bus The bus whose lines to look up
+ *  @return 0 if successful, -ENODEV if a GPIO has no descriptor
+ */
+static int row_lines_init(struct ledmsg_bus *bus) {
+    struct ledmsg_hw *hw = bus->priv;
+    unsigned int i;
+
+    hw->rowLines[ROW_LINE_BLK] = gpio_to_desc(gpioBLK);
+    hw->rowLines[ROW_LINE_A0]  = gpio_to_desc(gpioA0);
+    hw->rowLines[ROW_LINE_A1]  = gpio_to_desc(gpioA1);
+    hw->rowLines[ROW_LINE_A2]  = gpio_to_desc(gpioA2);
+    hw->rowLines[ROW_LINE_STB] = gpio_to_desc(gpioSTB);
+
+    for (i = 0; i < NUM_ROW_LINES; ++i)
+        if (!hw->rowLines[i])
+            return -ENODEV;
+    return 0;
+}
+
+/** @brief Internal: Looks up the descriptors of all the GPIOs requested in ledmsgchar_init()
+ *  The data lines come first, in panel order, so a compiled lane bitmap is
+ *  also the bitmap of the data lines. CLK comes right after them.
+ *  @param bus The bus whose lines to look up
+ *  @return 0 if successful, -ENODEV if a GPIO has no descriptor
+ */
+static int gpiod_backend_init(struct ledmsg_bus *bus) {
+    struct ledmsg_hw *hw = bus->priv;
+    unsigned int i;
+
+    for (i = 0; i < bus->numPanels; ++i)
+        hw->dataLines[i] = gpio_to_desc(dataGpios[i]);
+    hw->dataLines[bus->numPanels] = gpio_to_desc(gpioCLK);
+    hw->numDataLines = bus->numPanels + 1;
+
+    for (i = 0; i < hw->numDataLines; ++i)
+        if (!hw->dataLines[i])
+            return -ENODEV;
+    return row_lines_init(bus);
+}
+
+/** @brief Internal: Writes a compiled row to the data chips with two array writes per bit
+ *  Data changes together with the falling clock edge and is sampled on the
+ *  rising one, so the data lines and CLK can share a write. The lane bitmaps
+ *  already are the data line bits of the line bitmap, so every panel on the
+ *  bus is shifted by the same two writes.
+ *
+ *  @param bus The bus to write to
+ *  @param stream bus->rowBits lane bitmaps, bit k for the data line of panel k
+ */
+static void gpiod_write_row(struct ledmsg_bus *bus, const u8 *stream) {
+    struct ledmsg_hw *hw = bus->priv;
+    unsigned long clk = BIT(bus->numPanels);
+    unsigned long lines = 0;
+    unsigned int i;
+    for (i = 0; i < bus->rowBits; ++i) {
+        lines = stream[i];
+        gpiod_set_raw_array_value(hw->numDataLines, hw->dataLines, NULL, &lines);
+        lines |= clk;
+        gpiod_set_raw_array_value(hw->numDataLines, hw->dataLines, NULL, &lines);
+    }
+    lines &= ~clk;                  // Leave the clock low
+    gpiod_set_raw_array_value(hw->numDataLines, hw->dataLines, NULL, &lines);
+}
+
+/** @brief Internal: Blanks the display, switches to a row and latches its data with three array writes
+ *
+ *  @param bus The bus to latch
+ *  @param rowNum The row whose data was just shifted in
+ */
+static void gpiod_latch_row(struct ledmsg_bus *bus, unsigned int rowNum) {
+    struct ledmsg_hw *hw = bus->priv;
+    unsigned long lines;
+
+    lines = BIT(ROW_LINE_BLK) | ((unsigned long)(rowNum & 7) << ROW_LINE_A0);
+    gpiod_set_raw_array_value(NUM_ROW_LINES, hw->rowLines, NULL, &lines);
+    lines |= BIT(ROW_LINE_STB);
+    gpiod_set_raw_array_value(NUM_ROW_LINES, hw->rowLines, NULL, &lines);
+    lines &= ~(BIT(ROW_LINE_STB) | BIT(ROW_LINE_BLK));
+    gpiod_set_raw_array_value(NUM_ROW_LINES, hw->rowLines, NULL, &lines);
+}
+
+/** @brief Internal: Turns the display off until the next latch with a single line write
+ *  @param bus The bus to blank
+ */
+static void gpiod_blank(struct ledmsg_bus *bus) {
+    struct ledmsg_hw *hw = bus->priv;
+
+    gpiod_set_raw_value(hw->rowLines[ROW_LINE_BLK], 1);
+}
+
+static const struct ledmsg_backend gpiodBackend = {
+    .name = "gpiod",
+    .streamScale = 8,
+    .parallel = true,
+    .init = gpiod_backend_init,
+    .compile_row = ledmsg_compile_levels,
+    .write_row = gpiod_write_row,
+    .latch_row = gpiod_latch_row,
+    .blank = gpiod_blank,
+};
+
+/* spi backend: a row is shifted MSB first, exactly the SPI mode 0 byte stream,
+ * so the controller clocks it out (with DMA where the controller can) and only
+ * the row control lines are driven through gpiod. The compiled rows live in
+ * kmalloc() memory, which is DMA safe. There is a single MOSI, so the bus can
+ * only have one panel; chained panels are one long row. */
+
+/** @brief Internal: Claims a chip select on the SPI bus and looks up the row control GPIOs
+ *  The device gets a modalias no driver matches, so nothing else binds to it.
+ *  @param bus The bus to set up
+ *  @return 0 if successful, a negative error code otherwise
+ */
+static int spi_backend_init(struct ledmsg_bus *bus) {
+    struct spi_board_info info = {
+        .modalias = "ledmsgchar",
+        .max_speed_hz = spiSpeedHz,
+        .bus_num = spiBus,
+        .chip_select = spiChipSelect,
+        .mode = SPI_MODE_0,
+    };
+    struct ledmsg_hw *hw = bus->priv;
+    struct spi_master *master;
+    int ret;
+
+    ret = row_lines_init(bus);
+    if (ret)
+        return ret;
+
+    master = spi_busnum_to_master(spiBus);
+    if (!master) {
+        LOG_ALERT("no SPI bus %d", spiBus);
+        return -ENODEV;
+    }
+    hw->spiDev = spi_new_device(master, &info);
+    put_device(&master->dev);
+    if (!hw->spiDev) {
+        LOG_ALERT("could not claim chip select %d on SPI bus %d", spiChipSelect, spiBus);
+        return -EBUSY;
+    }
+
+    hw->spiXfer.len = bus->rowBytes;
+    hw->spiXfer.bits_per_word = 8;
+    spi_message_init(&hw->spiMsg);
+    spi_message_add_tail(&hw->spiXfer, &hw->spiMsg);
+    return 0;
+}
+
+/** @brief Internal: Gives the chip select back
+ *  @param bus The bus to tear down
+ */
+static void spi_backend_exit(struct ledmsg_bus *bus) {
+    struct ledmsg_hw *hw = bus->priv;
+
+    spi_unregister_device(hw->spiDev);
+    hw->spiDev = NULL;
+}
+
+/** @brief Internal: Compiles a row for the spi backend, the pixels already are the byte stream
+ *
+ *  @param bus The bus the row is for
+ *  @param rowData A pointer to bus->rowBytes bytes of pixels
+ *  @param stream Where to put the bus->rowBytes bytes to send
+ */
+static void spi_compile_row(const struct ledmsg_bus *bus, const u8 *rowData, u8 *stream) {
+    memcpy(stream, rowData, bus->rowBytes);
+}
+
+/** @brief Internal: Shifts a compiled row out through the SPI controller
+ *  Returns once the transfer is done, so the row can be latched right after.
+ *
+ *  @param bus The bus to write to
+ *  @param stream bus->rowBytes bytes from spi_compile_row()
+ */
+static void spi_write_row(struct ledmsg_bus *bus, const u8 *stream) {
+    struct ledmsg_hw *hw = bus->priv;
+    int ret;
+
+    hw->spiXfer.tx_buf = stream;
+    ret = spi_sync(hw->spiDev, &hw->spiMsg);
+    if (ret)
+        LOG_DEBUG("SPI transfer failed (%d)", ret);
+}
+
+static const struct ledmsg_backend spiBackend = {
+    .name = "spi",
+    .streamScale = 1,
+    .noDataGpios = true,
+    .init = spi_backend_init,
+    .exit = spi_backend_exit,
+    .compile_row = spi_compile_row,
+    .write_row = spi_write_row,
+    .latch_row = gpiod_latch_row,
+    .blank = gpiod_blank,
+};
+
+static const struct ledmsg_backend *backends[] = { &gpiodBackend, &legacyBackend, &spiBackend };
+
+/** @brief Internal: Finds the backend named by the backend parameter
+ *  @return The backend, or NULL if there is none by that name
+ */
+static const struct ledmsg_backend *find_backend(void) {
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(backends); ++i)
+        if (sysfs_streq(backend, backends[i]->name))
+            return backends[i];
+    LOG_ALERT("unknown backend %s", backend);
+    return NULL;
+}
+
+/** @brief Internal: Initializes the backend of a bus
+ *  A GPIO backend falls back to the legacy backend if it can't be set up; both
+ *  compile rows with ledmsg_compile_levels(), so frames compiled already stay valid.
+ *  @param bus The bus to set up
+ *  @return 0 if successful, a negative error code otherwise
+ */
+static int init_backend(struct ledmsg_bus *bus) {
+    int ret;
+
+    ret = bus->output->init ? bus->output->init(bus) : 0;
+    if (ret && !bus->output->noDataGpios && bus->output != &legacyBackend) {
+        LOG_ALERT("backend %s failed (%d), falling back to %s", bus->output->name, ret, legacyBackend.name);
+        bus->output = &legacyBackend;
+        ret = 0;
+    }
+    if (!ret)
+        LOG_INFO("using the %s backend for %u panel(s)", bus->output->name, bus->numPanels);
+    return ret;
+}
+
+/** @brief Internal: Number of bit-planes grayscale frames are committed with
+ *  @return grayBits, clamped to what a frame can hold
+ */
+static unsigned int gray_planes(void) {
+    return clamp_t(unsigned int, READ_ONCE(grayBits), 1, LEDMSG_MAX_GRAY_BITS);
+}
+
+/** @brief Internal: Number of bit-planes a frame written in the given format is committed with
+ *  grayBits can change at any time, so a caller reads this once and sizes
+ *  and decodes with the same value.
+ *  @param format One of enum ledmsg_format
+ *  @return gray_planes() for LEDMSG_FMT_GRAY, 1 otherwise
+ */
+static unsigned int format_planes(int format) {
+    return (format == LEDMSG_FMT_GRAY) ? gray_planes() : 1;
+}
+
+/** @brief Periodic row update kthread loop
+ *  Runs SCHED_FIFO and sleeps on absolute high resolution deadlines. The next
+ *  row (or bit-plane of a row) is shifted in while the current one is still lit
+ *  and latched when its deadline expires, so on times don't depend on the shift
+ *  time. Deadlines advance by exactly the on time of the step that was lit so
+ *  wakeup latency doesn't add up into drift; if the thread falls more than a
+ *  row behind it resynchronizes instead of rushing through the missed rows.
+ *
+ *  Every row gets the same rowPeriodNs whatever the number of planes, so gray
+ *  frames refresh as fast as binary ones. The shortest plane should still be
+ *  longer than it takes to shift a row in, or the planes before it run long.
+ *
+ *  Dark rows are blanked rather than shifted in, and with skipRepeats a row
+ *  the panels hold already is not shifted again. Steps that leave the panels
+ *  as they are get no wakeup of their own, so a mostly dark or static sign
+ *  costs a fraction of the GPIO writes and wakeups.
+ *
+ *  @param arg The struct ledmsg_bus to scan
+ *  @return returns 0 if successful
+ */
+static int update_row(void *arg) {
+    struct ledmsg_bus *bus = arg;
+    struct ledmsg_scan_stats *stats = &bus->stats;
+    ktime_t deadline, now, shiftStart, rowStart = 0;
+    u64 period, slack, onTimeNs = 0;
+    unsigned int lastRow = 0;
+    bool latch;
+    s64 lateNs;
+
+    LOG_INFO("Update row thread has started running");
+    deadline = ktime_get();
+    ledmsg_bus_frame_boundary(bus, deadline);
+    while (!kthread_should_stop()) {          // Returns true when kthread_stop() is called
+        WRITE_ONCE(bus->skipRepeats, READ_ONCE(skipRepeats));
+        shiftStart = ktime_get();
+        latch = ledmsg_scan_shift(bus);
+        now = ktime_get();
+        ledmsg_hist_add(&stats->shift, ktime_to_ns(ktime_sub(now, shiftStart)));
+
+        // Wait for the end of the previous step's time slot
+        period = max_t(u64, READ_ONCE(rowPeriodNs), MIN_ROW_PERIOD_NS);
+        deadline = ktime_add_ns(deadline, onTimeNs);
+        slack = min_t(u64, READ_ONCE(rowSlackNs), onTimeNs / 8);   // Keep short planes accurate
+        onTimeNs = ledmsg_scan_on_time(bus, period);
+        if (!latch)
+            continue;                   // The panels stay as they are, sleep through to the next step
+        if (ktime_before(now, deadline)) {
+            set_current_state(TASK_INTERRUPTIBLE);
+            schedule_hrtimeout_range(&deadline, slack, HRTIMER_MODE_ABS);
+        } else {
+            ++stats->missed;
+            if (ktime_to_ns(ktime_sub(now, deadline)) > period) {
+                deadline = now;
+                ++stats->resyncs;
+            }
+        }
+
+        now = ktime_get();
+        ledmsg_scan_latch(bus);
+
+        lateNs = ktime_to_ns(ktime_sub(now, deadline));
+        ledmsg_hist_add(&stats->late, lateNs);
+        if (bus->plane == 0) {
+            // Only rows latched one after the other give a period, skipped steps merge slots
+            if (rowStart && bus->row == (lastRow + 1) % bus->numRows)
+                ledmsg_hist_add(&stats->period, ktime_to_ns(ktime_sub(now, rowStart)));
+            rowStart = now;
+            lastRow = bus->row;
+        }
+        stats->targetPeriodNs = period;
+        ++stats->steps;
+        trace_ledmsg_row_latch(bus->row, bus->plane, lateNs);
+    }
+    LOG_INFO("Thread has run to completion");
+    return 0;
+}
+
+/** @brief Internal: Prints a histogram as one line of the stats file
+ *  @param s The seq_file being printed
+ *  @param name What the histogram measures
+ *  @param hist The histogram
+ */
+static void show_hist(struct seq_file *s, const char *name, const struct ledmsg_hist *hist) {
+    unsigned int b;
+
+    seq_printf(s, "%s avg %u max %u hist", name, READ_ONCE(hist->avgNs), READ_ONCE(hist->maxNs));
+    for (b = 0; b < LEDMSG_HIST_BUCKETS; ++b)
+        seq_printf(s, " %lu", READ_ONCE(hist->count[b]));
+    seq_putc(s, '\n');
+}
+
+/** @brief Internal: Prints the statistics of a bus and its panels
+ *  Durations are in ns. Histogram bucket 0 counts durations under 1024 ns and
+ *  each bucket after it twice as long ones as the one before.
+ *  @param s The seq_file being printed
+ *  @param unused Not used
+ *  @return 0
+ */
+static int stats_show(struct seq_file *s, void *unused) {
+    const struct ledmsg_bus *bus = s->private;
+    const struct ledmsg_scan_stats *stats = &bus->stats;
+    const struct ledmsg_panel_stats *ps;
+    unsigned int i;
+
+    seq_printf(s, "backend %s\n", bus->output->name);
+    seq_printf(s, "target_row_period_ns %u\n", READ_ONCE(stats->targetPeriodNs));
+    seq_printf(s, "steps %lu\n", READ_ONCE(stats->steps));
+    seq_printf(s, "frames %lu\n", READ_ONCE(stats->frames));
+    seq_printf(s, "deadline_misses %lu\n", READ_ONCE(stats->missed));
+    seq_printf(s, "resyncs %lu\n", READ_ONCE(stats->resyncs));
+    seq_printf(s, "blank_steps %lu\n", READ_ONCE(stats->blankSteps));
+    seq_printf(s, "repeat_steps %lu\n", READ_ONCE(stats->repeatSteps));
+    show_hist(s, "row_period_ns", &stats->period);
+    show_hist(s, "latch_late_ns", &stats->late);
+    show_hist(s, "shift_ns", &stats->shift);
+    seq_printf(s, "opens %d\n", numberOpens);
+    for (i = 0; i < bus->numPanels; ++i) {
+        ps = &bus->panels[i].stats;
+        seq_printf(s, "panel%u committed %lu overwritten %lu shown %lu waits %lu\n", i,
+                   READ_ONCE(ps->committed), READ_ONCE(ps->overwritten),
+                   READ_ONCE(ps->shown), READ_ONCE(ps->waits));
+        seq_printf(s, "panel%u ", i);
+        show_hist(s, "wait_ns", &ps->wait);
+    }
+    return 0;
+}
+
+/** @brief Internal: Opens the stats file
+ *  @param inodep The debugfs inode, its private data is the bus
+ *  @param filep A pointer to a file object
+ *  @return 0 if successful, a negative error code otherwise
+ */
+static int stats_open(struct inode *inodep, struct file *filep) {
+    return single_open(filep, stats_show, inodep->i_private);
+}
+
+/** @brief Internal: Clears the statistics on any write to the stats file
+ *  Counters being updated at the same moment may keep a stale count.
+ *  @param filep A pointer to a file object
+ *  @param buffer Ignored
+ *  @param len The number of bytes written
+ *  @param offset Ignored
+ *  @return len
+ */
+static ssize_t stats_write(struct file *filep, const char __user *buffer, size_t len, loff_t *offset) {
+    struct ledmsg_bus *bus = ((struct seq_file *)filep->private_data)->private;
+    unsigned int i;
+
+    memset(&bus->stats, 0, sizeof bus->stats);
+    for (i = 0; i < bus->numPanels; ++i)
+        memset(&bus->panels[i].stats, 0, sizeof bus->panels[i].stats);
+    return len;
+}
+
+static const struct file_operations statsFops = {
+    .owner = THIS_MODULE,
+    .open = stats_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .write = stats_write,
+    .release = single_release,
+};
+
+/** @brief The LKM initialization function
+ *  The static keyword restricts the visibility of the function to within this C file. The __init
+ *  macro means that for a built-in driver (not a LKM) the function is only used at initialization
+ *  time and that it can be discarded and its memory freed up after that point.
+ *  @return returns 0 if successful
+ */
+static int __init ledmsgchar_init(void) {
+    struct device *dev;
+    int result = -ENOMEM;
+    unsigned int i;
+
+    printk(KERN_INFO "LEDMSGCHAR: Initializing the LEDMSGCHAR LKM\n");
+
+    // Try to dynamically allocate a major number for the device -- more difficult but worth it
+    majorNumber = register_chrdev(0, DEVICE_NAME, &fops);
+    if (majorNumber<0){
+        printk(KERN_ALERT "LEDMSGCHAR: failed to register a major number\n");
+        return majorNumber;
+    }
+    printk(KERN_INFO "LEDMSGCHAR: registered correctly with major number %d\n", majorNumber);
+
+    // Register the device class
+    ledmsgcharClass = class_create(THIS_MODULE, CLASS_NAME);
+    if (IS_ERR(ledmsgcharClass)){               // Check for error and clean up if there is
+        unregister_chrdev(majorNumber, DEVICE_NAME);
+        printk(KERN_ALERT "LEDMSGCHAR: Failed to register device class\n");
+        return PTR_ERR(ledmsgcharClass);        // Correct way to return an error on a pointer
+    }
+    printk(KERN_INFO "LEDMSGCHAR: device class registered correctly\n");
+
+    bus.output = find_backend();
+    if (!bus.output) {
+        result = -EINVAL;
+        goto error;
+    }
+
+    ledmsg_bus_size(&bus, panelRows, panelRowBytes, canvasWidth, canvasHeight);
+    bus.numPanels = numDataGpios;
+    if (bus.numPanels > 1 && !bus.output->parallel) {
+        LOG_ALERT("the %s backend drives a single data line", bus.output->name);
+        result = -EINVAL;
+        goto error;
+    }
+
+    /* Get a hold of the GPIOs */
+    // Is the GPIO a valid GPIO number (e.g., not all gpio are available)
+    INIT_GPIO(gpioA0);
+    INIT_GPIO(gpioA1);
+    INIT_GPIO(gpioA2);
+    if (!bus.output->noDataGpios) {
+        INIT_GPIO(gpioCLK);
+        for (i = 0; i < bus.numPanels; ++i)
+            INIT_GPIO(dataGpios[i]);
+    }
+    INIT_GPIO(gpioSTB);
+    INIT_GPIO(gpioBLK);
+
+    blank = 0;
+    printk(KERN_INFO "LEDMSGCHAR: Blank state is %d\n", gpio_get_value(gpioBLK));
+    result = -ENOMEM;
+
+    ledmsg_build_glyph_cache();
+    result = ledmsg_bus_init(&bus);
+    if (result)
+        goto error;
+
+    result = init_backend(&bus);
+    if (result)
+        goto error;
+
+    // Register a device for each panel
+    for (i = 0; i < bus.numPanels; ++i) {
+        dev = device_create(ledmsgcharClass, NULL, MKDEV(majorNumber, i), &bus.panels[i], DEVICE_NAME "%u", i);
+        if (IS_ERR(dev)) {
+            printk(KERN_ALERT "Failed to create the device\n");
+            result = PTR_ERR(dev);
+            goto error_exit_backend;
+        }
+        bus.panels[i].device = dev;
+    }
+    printk(KERN_INFO "LEDMSGCHAR: %u device(s) created correctly\n", bus.numPanels); // Made it! device was initialized
+
+    // Statistics are optional, the driver works without debugfs
+    debugDir = debugfs_create_dir(DEVICE_NAME, NULL);
+    debugfs_create_file("stats", 0644, debugDir, &bus, &statsFops);
+
+    bus.task = kthread_run(update_row, &bus, "ledmsgchar_update_row_thread");
+    if (IS_ERR(bus.task)) {
+        printk(KERN_ALERT "LEDMSGCHAR: failed to create row update task");
+        result = PTR_ERR(bus.task);
+        goto error_exit_backend;
+    }
+    sched_set_fifo(bus.task);               // Row timing must not wait behind normal tasks
+
+    return 0;
+
+error_exit_backend:
+    debugfs_remove_recursive(debugDir);
+    if (bus.output->exit)
+        bus.output->exit(&bus);
+error:
+    if (bus.panels) {
+        for (i = 0; i < bus.numPanels; ++i)
+            if (bus.panels[i].device)
+                device_destroy(ledmsgcharClass, MKDEV(majorNumber, i));
+    }
+    ledmsg_bus_free(&bus);
+    release_gpios();
+    class_destroy(ledmsgcharClass);
+    unregister_chrdev(majorNumber, DEVICE_NAME);
+    return result;
+}
+
+/** @brief The LKM cleanup function
+ *  Similar to the initialization function, it is static. The __exit macro notifies that if this
+ *  code is used for a built-in driver (not a LKM) that this function is not required.
+ */
+static void __exit ledmsgchar_exit(void) {
+    unsigned int i;
+
+    debugfs_remove_recursive(debugDir);
+    kthread_stop(bus.task);
+    if (bus.output->exit)
+        bus.output->exit(&bus);
+    for (i = 0; i < bus.numPanels; ++i)
+        device_destroy(ledmsgcharClass, MKDEV(majorNumber, i)); // remove the device
+    ledmsg_bus_free(&bus);
+    release_gpios();
+
+    class_unregister(ledmsgcharClass);      // unregister the device class
+    class_destroy(ledmsgcharClass);         // remove the device class
+    unregister_chrdev(majorNumber, DEVICE_NAME); // unregister the major number
+    printk(KERN_INFO "LEDMSGCHAR: Goodbye from the LKM!\n");
+}
+
+/** @brief The device open function that is called each time the device is opened
+ *  This finds the panel from the minor number, allocates the per file state
+ *  and increments the numberOpens counter.
+ *  @param inodep A pointer to an inode object (defined in linux/fs.h)
+ *  @param filep A pointer to a file object (defined in linux/fs.h)
+ */
+static int dev_open(struct inode *inodep, struct file *filep){
+   struct ledmsg_file *lf;
+   unsigned int minor = iminor(inodep);
+
+   if (minor >= bus.numPanels)
+       return -ENODEV;
+   lf = kzalloc(sizeof *lf, GFP_KERNEL);
+   if (!lf)
+       return -ENOMEM;
+   lf->panel = &bus.panels[minor];
+   lf->format = LEDMSG_FMT_HEX;
+   lf->writeMode = LEDMSG_WRITE_BLOCK;
+   filep->private_data = lf;
+
+   numberOpens++;
+   LOG_DEBUG("Device %u has been opened %d time(s)", minor, numberOpens);
+   return 0;
+}
+
+/** @brief Internal: Takes writeLock
+ *  The lock is only ever held for short stretches, never while waiting for a
+ *  frame slot, so O_NONBLOCK files take it too instead of failing with
+ *  -EAGAIN right after poll() said the panel was writable.
+ *  @param filep A pointer to a file object
+ *  @return 0 once the lock is held, a negative error code otherwise
+ */
+static int lock_writer(struct file *filep) {
+    struct ledmsg_file *lf = filep->private_data;
+
+    return mutex_lock_interruptible(&lf->panel->writeLock);
+}
+
+/** @brief Internal: Waits until the back buffer may be published, per the file's write mode
+ *  In LEDMSG_WRITE_LATEST mode this never waits. Must be called with writeLock
+ *  held, before touching the back buffer: the lock is dropped while sleeping so
+ *  other writers are not held up, and taken again before checking once more,
+ *  since one of them may have published a frame meanwhile. It is held again
+ *  on return, whatever the result.
+ *  @param filep A pointer to a file object
+ *  @return 0 if the back buffer can be published, a negative error code otherwise
+ */
+static int wait_for_frame_slot(struct file *filep) {
+    struct ledmsg_file *lf = filep->private_data;
+    struct ledmsg_panel *panel = lf->panel;
+    ktime_t start;
+    int ret;
+
+    if (lf->writeMode == LEDMSG_WRITE_LATEST)
+        return 0;
+    while (ledmsg_frame_pending(panel)) {
+        if (filep->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        mutex_unlock(&panel->writeLock);
+        start = ktime_get();
+        ret = wait_event_interruptible(panel->frameWait, !ledmsg_frame_pending(panel));
+        mutex_lock(&panel->writeLock);
+        ++panel->stats.waits;
+        ledmsg_hist_add(&panel->stats.wait, ktime_to_ns(ktime_sub(ktime_get(), start)));
+        if (ret)
+            return ret;
+    }
+    return 0;
+}
+
+/** @brief Internal: Size of a frame written in the given format
+ *  @param bus The bus giving the canvas size
+ *  @param format One of enum ledmsg_format
+ *  @return The number of bytes write() needs for a whole frame
+ */
+static size_t frame_length(const struct ledmsg_bus *bus, int format) {
+    switch (format) {
+    case LEDMSG_FMT_BINARY:
+        return bus->canvasBytes;
+    case LEDMSG_FMT_GRAY:
+        return bus->canvasBytes * 8;
+    default:
+        return bus->canvasBytes * 2;
+    }
+}
+
+/** @brief Internal: Copies a frame in from user space and decodes it into a frame's planes
+ *  A binary frame is canvasBytes bytes in the frame buffer layout and is taken
+ *  with a single copy_from_user(). A hex frame is two ASCII characters per
+ *  byte of that. A gray frame has a byte per canvas pixel and is split into
+ *  bit-planes here. The frame is not compiled. Must be called with writeLock held.
+ *
+ *  @param panel The panel the frame belongs to
+ *  @param format One of enum ledmsg_format
+ *  @param buffer frame_length(format) bytes of user memory
+ *  @param frame The frame to fill in, its data must have room for numPlanes planes
+ *  @param numPlanes format_planes(format), as read by the caller
+ *  @return 0 if successful, -EINVAL if a hex frame has a non hex character,
+ *  another negative error code otherwise
+ */
+static int decode_frame(struct ledmsg_panel *panel, int format, const char __user *buffer,
+                        struct ledmsg_frame *frame, unsigned int numPlanes) {
+    size_t canvasBytes = panel->bus->canvasBytes;
+
+    frame->numPlanes = numPlanes;
+    if (format == LEDMSG_FMT_BINARY) {
+        if (copy_from_user(frame->data, buffer, canvasBytes))
+            return -EFAULT;
+    } else if (format == LEDMSG_FMT_GRAY) {
+        if (copy_from_user(panel->grayBuf, buffer, canvasBytes * 8))
+            return -EFAULT;
+        ledmsg_gray_to_planes(panel->bus, panel->grayBuf, numPlanes, frame->data, canvasBytes);
+    } else {
+        if (copy_from_user(panel->hexBuf, buffer, canvasBytes * 2))
+            return -EFAULT;
+        return ledmsg_decode_hex(panel->hexBuf, frame->data, canvasBytes);
+    }
+    return 0;
+}
+
+/** @brief Internal: Copies part of a frame in from user space and decodes it into every plane
+ *  Binary and hex bytes turn their pixels full on or off in all the frame's
+ *  planes; gray pixels are split into the planes like in decode_frame().
+ *  Must be called with writeLock held.
+ *
+ *  @param panel The panel the frame belongs to
+ *  @param format LEDMSG_FMT_HEX, LEDMSG_FMT_BINARY or LEDMSG_FMT_GRAY
+ *  @param buffer numBytes canvas bytes worth of user memory in that format
+ *  @param frame The frame to patch
+ *  @param offset Canvas byte of the first pixels
+ *  @param numBytes Bytes of each plane to rewrite
+ *  @return 0 if successful, a negative error code otherwise
+ */
+static int decode_span(struct ledmsg_panel *panel, int format, const char __user *buffer,
+                       struct ledmsg_frame *frame, size_t offset, size_t numBytes) {
+    size_t canvasBytes = panel->bus->canvasBytes;
+    u8 *dst = frame->data + offset;
+    unsigned int p;
+
+    if (format == LEDMSG_FMT_GRAY) {
+        if (copy_from_user(panel->grayBuf, buffer, numBytes * 8))
+            return -EFAULT;
+        ledmsg_gray_to_planes(panel->bus, panel->grayBuf, frame->numPlanes, dst, numBytes);
+        return 0;
+    }
+    if (format == LEDMSG_FMT_BINARY) {
+        if (copy_from_user(dst, buffer, numBytes))
+            return -EFAULT;
+    } else {
+        if (copy_from_user(panel->hexBuf, buffer, numBytes * 2))
+            return -EFAULT;
+        if (ledmsg_decode_hex(panel->hexBuf, dst, numBytes))
+            return -EINVAL;
+    }
+    for (p = 1; p < frame->numPlanes; ++p)
+        memcpy(dst + p * canvasBytes, dst, numBytes);
+    return 0;
+}
+
+/** @brief Internal: Composites the layers again for some rows of the newest frame and shows it
+ *  Must be called with writeLock held, once wait_for_frame_slot() said yes.
+ *  @param panel The panel
+ *  @param numPlanes Bit-planes the frame below the layers needs at least, 0 for any
+ *  @param rows Bit r set for each canvas row to composite again
+ */
+static void show_layers(struct ledmsg_panel *panel, unsigned int numPlanes, u64 rows) {
+    struct ledmsg_frame *frame;
+
+    if (numPlanes <= panel->frames[panel->latest].numPlanes)
+        numPlanes = 0;
+    frame = ledmsg_edit_back(panel, numPlanes);
+    frame->dirtyRows |= rows;
+    ledmsg_commit_rows(panel, frame);
+    ledmsg_publish_rows(panel, rows);
+}
+
+/** @brief Internal: Rewrites part of the newest frame and shows the result
+ *  The part is numSpans runs of spanBytes canvas bytes, the first at canvas
+ *  byte offset and each one a canvas row below the one before; in user memory
+ *  they are pitch bytes apart. Only the rows touched are decoded and compiled.
+ *
+ *  @param filep A pointer to a file object, its format applies to the data
+ *  @param buffer The user memory holding the runs
+ *  @param pitch Bytes from one run to the next in buffer
+ *  @param offset Canvas byte where the first run goes
+ *  @param spanBytes Canvas bytes per run
+ *  @param numSpans Number of runs, at least one
+ *  @return 0 if successful, a negative error code otherwise. Must be called
+ *  with writeLock held.
+ */
+static int write_spans(struct file *filep, const char __user *buffer, size_t pitch,
+                       size_t offset, size_t spanBytes, unsigned int numSpans) {
+    struct ledmsg_file *lf = filep->private_data;
+    struct ledmsg_panel *panel = lf->panel;
+    const struct ledmsg_bus *bus = panel->bus;
+    size_t last = offset + (numSpans - 1) * bus->canvasRowBytes + spanBytes - 1;
+    u64 rows = GENMASK_ULL(last / bus->canvasRowBytes, offset / bus->canvasRowBytes);
+    struct ledmsg_frame *frame;
+    unsigned int numPlanes, i;
+    int ret;
+
+    ret = wait_for_frame_slot(filep);
+    if (ret)
+        return ret;
+    ledmsg_free_retired_playlists(panel);
+
+    numPlanes = (lf->format == LEDMSG_FMT_GRAY) ? gray_planes() : 0;
+    frame = lf->layer ? ledmsg_edit_layer(panel, lf->layer, numPlanes) : ledmsg_edit_back(panel, numPlanes);
+    for (i = 0; i < numSpans; ++i) {
+        ret = decode_span(panel, lf->format, buffer + i * pitch, frame,
+                          offset + i * bus->canvasRowBytes, spanBytes);
+        if (ret) {
+            frame->staleRows = LEDMSG_ALL_ROWS;     // Half written, bring it all over next time
+            return ret;                             // A layer's draft is just dropped
+        }
+    }
+    if (lf->layer) {
+        ledmsg_commit_layer(panel, lf->layer);
+        show_layers(panel, frame->numPlanes, ledmsg_layer_rows(bus, lf->layer, rows));
+        return 0;
+    }
+    frame->dirtyRows |= rows;
+    ledmsg_commit_rows(panel, frame);
+    ledmsg_publish_rows(panel, rows);
+    return 0;
+}
+
+/** @brief Internal: Handles a write() covering only part of a frame, see enum ledmsg_format
+ *  @param filep A pointer to a file object
+ *  @param buffer The data, in the file's format
+ *  @param len Its length
+ *  @param pos Where in the frame it goes, in the units of the format
+ *  @return The number of bytes consumed, or a negative error code. Must be
+ *  called with writeLock held.
+ */
+static ssize_t write_part(struct file *filep, const char __user *buffer, size_t len, loff_t pos) {
+    struct ledmsg_file *lf = filep->private_data;
+    const struct ledmsg_bus *bus = lf->panel->bus;
+    size_t frameLen = frame_length(bus, lf->format);
+    size_t unit = frameLen / bus->canvasBytes;
+    size_t start;
+    int ret;
+
+    if (len == 0)
+        return 0;
+    if (pos < 0 || pos >= frameLen)
+        return -ENOSPC;
+    start = pos;
+    len = min(len, frameLen - start);
+    if (start % unit || len % unit)
+        return -EINVAL;
+    ret = write_spans(filep, buffer, 0, start / unit, len / unit, 1);
+    return ret ? ret : len;
+}
+
+/** @brief Internal: Decodes one write() into the back buffer and shows it
+ *  The frame is decoded according to the format selected for this file and
+ *  handed to the update_row task, which shows it at its next frame boundary.
+ *  Anything but a whole frame at position 0 goes to write_part() instead.
+ *  A file with a layer writes the layer and the layers are composited again;
+ *  a rejected write leaves the layer as it was. Must be called with writeLock held.
+ *
+ *  @param filep A pointer to a file object
+ *  @param buffer The data, in the file's format
+ *  @param len Its length
+ *  @param pos The position in the frame
+ *  @return The number of bytes consumed, or a negative error code
+ */
+static ssize_t write_frame(struct file *filep, const char __user *buffer, size_t len, loff_t pos) {
+    struct ledmsg_file *lf = filep->private_data;
+    struct ledmsg_panel *panel = lf->panel;
+    struct ledmsg_frame *frame;
+    int ret;
+
+    if (lf->format == LEDMSG_FMT_TEXT) {
+        if (len == 0 || len > LEDMSG_MAX_TEXT_BYTES)
+            return -EINVAL;
+    } else if (pos != 0 || len < frame_length(panel->bus, lf->format)) {
+        return write_part(filep, buffer, len, pos);
+    }
+
+    ret = wait_for_frame_slot(filep);
+    if (ret)
+        return ret;
+    ledmsg_free_retired_playlists(panel);
+
+    frame = lf->layer ? ledmsg_edit_layer(panel, lf->layer, 0) : &panel->frames[panel->back];
+    if (lf->format == LEDMSG_FMT_TEXT) {
+        ret = copy_from_user(panel->textBuf, buffer, len) ? -EFAULT : 0;
+        if (!ret)
+            ledmsg_render_text(panel->bus, &lf->text, panel->textBuf, len, frame);
+    } else {
+        ret = decode_frame(panel, lf->format, buffer, frame, format_planes(lf->format));
+    }
+    if (ret) {
+        frame->staleRows = LEDMSG_ALL_ROWS;
+        return ret;
+    }
+    if (lf->layer) {
+        ledmsg_commit_layer(panel, lf->layer);
+        show_layers(panel, frame->numPlanes, LEDMSG_ALL_ROWS);
+        return len;
+    }
+    ledmsg_commit_frame(panel, frame);
+    ledmsg_publish_back(panel);
+    return len;
+}
+
+/** @brief This function is called whenever the device is being written to from
+ *  user space i.e. data is sent to the device from the user. See write_frame().
+ *
+ *  @param filep A pointer to a file object
+ *  @param buffer The buffer to that contains the string to write to the device
+ *  @param len The length of the array of data that is being passed in the const char buffer
+ *  @param offset The position in the frame, not moved by the write
+ *  @return The number of characters consumed by the write operation.
+ */
+static ssize_t dev_write(struct file *filep, const char *buffer, size_t len, loff_t *offset) {
+    struct ledmsg_file *lf = filep->private_data;
+    ssize_t ret;
+
+    ret = lock_writer(filep);
+    if (ret)
+        return ret;
+    ret = write_frame(filep, buffer, len, *offset);
+    mutex_unlock(&lf->panel->writeLock);
+    if (ret > 0)
+        LOG_DEBUG("Consumed %zd bytes from user", ret);
+    return ret;
+}
+
+/** @brief Called for writev(), pwritev() and io_uring writes, a batch of write()s in one call
+ *  Each segment is handled like a write() of its own at the same position,
+ *  in order, so a segment can be a whole frame, a text or part of a frame.
+ *  writeLock is taken once for the batch, so no other writer gets in between,
+ *  except while a LEDMSG_WRITE_BLOCK segment waits for its frame slot. Stops
+ *  at the first segment that fails or is not taken whole. A single buffer
+ *  (ITER_UBUF, as io_uring can hand in) is one segment.
+ *
+ *  Written for kernels 6.0 to 6.3: user_backed_iter() and ITER_UBUF came in
+ *  with 6.0, and ledmsgchar_init() still passes THIS_MODULE to class_create(),
+ *  which 6.4 dropped. Checked against that range's headers, not yet run on
+ *  a board.
+ *
+ *  @param iocb The I/O control block, giving the file and the position
+ *  @param from The segments, in user memory
+ *  @return The number of bytes consumed by the segments done, or a negative
+ *  error code if the first one failed
+ */
+static ssize_t dev_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    struct file *filep = iocb->ki_filp;
+    struct ledmsg_file *lf = filep->private_data;
+    struct iovec iov;
+    ssize_t done = 0, ret;
+
+    if (!user_backed_iter(from))
+        return -EINVAL;
+    ret = lock_writer(filep);
+    if (ret)
+        return ret;
+    while (iov_iter_count(from)) {
+        if (iter_is_ubuf(from)) {               // iov_iter_iovec() only knows iovec arrays
+            iov.iov_base = from->ubuf + from->iov_offset;
+            iov.iov_len = iov_iter_count(from);
+        } else {
+            iov = iov_iter_iovec(from);
+        }
+        ret = iov.iov_len ? write_frame(filep, iov.iov_base, iov.iov_len, iocb->ki_pos) : 0;
+        if (ret < 0)
+            break;
+        iov_iter_advance(from, ret);            // Also steps over an empty segment
+        done += ret;
+        if ((size_t)ret < iov.iov_len)
+            break;
+    }
+    mutex_unlock(&lf->panel->writeLock);
+    LOG_DEBUG("Consumed %zd bytes from user in a batch", done);
+    return done ?: ret;
+}
+
+/** @brief Moves the position the next write() goes to, within one frame of the file's format
+ *  @param filep A pointer to a file object
+ *  @param offset The new position, relative to whence
+ *  @param whence SEEK_SET, SEEK_CUR or SEEK_END, the end being the frame length
+ *  @return The new position, or a negative error code
+ */
+static loff_t dev_llseek(struct file *filep, loff_t offset, int whence) {
+    struct ledmsg_file *lf = filep->private_data;
+    size_t frameLen = (lf->format == LEDMSG_FMT_TEXT) ? 0 : frame_length(lf->panel->bus, lf->format);
+
+    return fixed_size_llseek(filep, offset, whence, frameLen);
+}
+
+/** @brief Internal: Rewrites a rectangle of the frame for LEDMSG_IOC_WRITE_RECT
+ *  @param filep A pointer to a file object, its format applies to the data
+ *  @param ur The user space struct ledmsg_rect
+ *  @return 0 if successful, a negative error code otherwise
+ */
+static int write_rect(struct file *filep, const struct ledmsg_rect __user *ur) {
+    struct ledmsg_file *lf = filep->private_data;
+    const struct ledmsg_bus *bus = lf->panel->bus;
+    struct ledmsg_rect rect;
+    size_t rowLen;
+    int ret;
+
+    if (copy_from_user(&rect, ur, sizeof rect))
+        return -EFAULT;
+    if (lf->format == LEDMSG_FMT_TEXT || rect.reserved || !rect.width || !rect.height)
+        return -EINVAL;
+    if (rect.x % 8 || rect.width % 8 || rect.x > bus->canvasWidth || rect.width > bus->canvasWidth - rect.x)
+        return -EINVAL;
+    if (rect.y > bus->canvasHeight || rect.height > bus->canvasHeight - rect.y)
+        return -EINVAL;
+    rowLen = rect.width / 8 * (frame_length(bus, lf->format) / bus->canvasBytes);
+    if (rect.pitch && rect.pitch < rowLen)
+        return -EINVAL;
+    ret = lock_writer(filep);
+    if (ret)
+        return ret;
+    ret = write_spans(filep, u64_to_user_ptr(rect.data), rect.pitch ?: rowLen,
+                      rect.y * bus->canvasRowBytes + rect.x / 8, rect.width / 8, rect.height);
+    mutex_unlock(&lf->panel->writeLock);
+    return ret;
+}
+
+/** @brief Internal: Handles LEDMSG_IOC_SET_LAYER, gives the file a layer, moves it or takes it away
+ *  @param filep A pointer to a file object
+ *  @param ul The user space struct ledmsg_layer
+ *  @return 0 if successful, a negative error code otherwise
+ */
+static int set_layer(struct file *filep, const struct ledmsg_layer __user *ul) {
+    struct ledmsg_file *lf = filep->private_data;
+    struct ledmsg_panel *panel = lf->panel;
+    const struct ledmsg_bus *bus = panel->bus;
+    struct ledmsg_panel_layer *layer;
+    struct ledmsg_layer attr;
+    u8 *mask = NULL;
+    int ret;
+
+    if (copy_from_user(&attr, ul, sizeof attr))
+        return -EFAULT;
+    if (attr.flags & ~(LEDMSG_LAYER_ON | LEDMSG_LAYER_HIDDEN | LEDMSG_LAYER_OPAQUE))
+        return -EINVAL;
+    if (attr.x % 8 || attr.x >= bus->canvasWidth || attr.y >= bus->canvasHeight)
+        return -EINVAL;
+    if ((attr.flags & LEDMSG_LAYER_ON) && attr.mask) {
+        mask = kvmalloc(bus->canvasBytes, GFP_KERNEL);
+        if (!mask)
+            return -ENOMEM;
+        if (copy_from_user(mask, u64_to_user_ptr(attr.mask), bus->canvasBytes)) {
+            kvfree(mask);
+            return -EFAULT;
+        }
+    }
+
+    ret = lock_writer(filep);
+    if (ret)
+        goto out_free;
+    ret = wait_for_frame_slot(filep);
+    if (ret)
+        goto out;
+    ledmsg_free_retired_playlists(panel);
+
+    layer = lf->layer;
+    if (!(attr.flags & LEDMSG_LAYER_ON)) {
+        if (!layer)
+            goto out;
+        ledmsg_layer_free(layer);
+        lf->layer = NULL;
+        show_layers(panel, 0, LEDMSG_ALL_ROWS);
+        goto out;
+    }
+    if (!layer) {
+        layer = ledmsg_layer_alloc(panel);
+        if (!layer) {
+            ret = -ENOMEM;
+            goto out;
+        }
+        lf->layer = layer;
+    }
+    swap(layer->mask, mask);                    // The old mask is freed below
+    layer->z = attr.z;
+    layer->x = attr.x;
+    layer->y = attr.y;
+    layer->flags = attr.flags;
+    ledmsg_layer_place(panel, layer);
+    show_layers(panel, layer->frame.numPlanes, LEDMSG_ALL_ROWS);
+out:
+    mutex_unlock(&panel->writeLock);
+out_free:
+    kvfree(mask);
+    return ret;
+}
+
+/** @brief Internal: Handles LEDMSG_IOC_GET_LAYER, all zeros if the file has no layer
+ *  @param filep A pointer to a file object
+ *  @param ul The user space struct ledmsg_layer to fill in
+ *  @return 0 if successful, a negative error code otherwise
+ */
+static int get_layer(struct file *filep, struct ledmsg_layer __user *ul) {
+    struct ledmsg_file *lf = filep->private_data;
+    struct ledmsg_layer attr = { 0 };
+    int ret;
+
+    ret = lock_writer(filep);
+    if (ret)
+        return ret;
+    if (lf->layer) {
+        attr.z = lf->layer->z;
+        attr.x = lf->layer->x;
+        attr.y = lf->layer->y;
+        attr.flags = lf->layer->flags;
+    }
+    mutex_unlock(&lf->panel->writeLock);
+    return copy_to_user(ul, &attr, sizeof attr) ? -EFAULT : 0;
+}
+
+/** @brief Internal: Takes a snapshot of the frame the panel shows, in the file's format
+ *  Binary and hex snapshots hold the most significant bit-plane, so a gray
+ *  pixel counts as lit from half brightness up; gray ones the level of every
+ *  pixel. A text file gets hex. Must be called with writeLock held, which keeps
+ *  the frame from changing under the copy.
+ *
+ *  @param filep A pointer to a file object
+ *  @param ifChanged Only take it if the frame is not the one numbered seenSeq
+ *  @param seenSeq Sequence number of the frame the caller has
+ *  @return 0 if taken, 1 if skipped as unchanged, a negative error code otherwise
+ */
+static int take_snapshot(struct file *filep, bool ifChanged, u64 seenSeq) {
+    struct ledmsg_file *lf = filep->private_data;
+    struct ledmsg_panel *panel = lf->panel;
+    const struct ledmsg_bus *bus = panel->bus;
+    const struct ledmsg_frame *frame = ledmsg_shown_frame(panel);
+    const u8 *top = frame->composed + (frame->numPlanes - 1) * bus->canvasBytes;
+
+    lf->snapshotSeq = frame->seq;
+    if (ifChanged && frame->seq == seenSeq)
+        return 1;
+    if (!lf->snapshot) {
+        lf->snapshot = kvmalloc(bus->canvasBytes * 8, GFP_KERNEL);
+        if (!lf->snapshot)
+            return -ENOMEM;
+    }
+    lf->snapshotLen = frame_length(bus, lf->format);
+    if (lf->format == LEDMSG_FMT_GRAY)
+        ledmsg_planes_to_gray(bus, frame->composed, frame->numPlanes, lf->snapshot);
+    else if (lf->format == LEDMSG_FMT_BINARY)
+        memcpy(lf->snapshot, top, bus->canvasBytes);
+    else
+        ledmsg_encode_hex(top, (char *)lf->snapshot, bus->canvasBytes);
+    return 0;
+}
+
+/** @brief This function is called whenever device is being read from user space i.e. data is
+ *  being sent from the device to the user. A read at position 0 takes a snapshot of the frame
+ *  shown right now and reads carry on through it, so a frame read in pieces never tears.
+ *  @param filep A pointer to a file object (defined in linux/fs.h)
+ *  @param buffer The pointer to the buffer to which this function writes the data
+ *  @param len The length of the buffer
+ *  @param offset The position in the snapshot, moved past the bytes read
+ *  @return The number of bytes read, 0 at the end of the frame, or a negative error code
+ */
+static ssize_t dev_read(struct file *filep, char *buffer, size_t len, loff_t *offset) {
+    struct ledmsg_file *lf = filep->private_data;
+    struct ledmsg_panel *panel = lf->panel;
+    size_t start;
+    ssize_t ret;
+
+    ret = lock_writer(filep);
+    if (ret)
+        return ret;
+    if (*offset == 0 || !lf->snapshot) {
+        ret = take_snapshot(filep, false, 0);
+        if (ret)
+            goto out;
+    }
+    if (*offset < 0 || *offset >= lf->snapshotLen)
+        goto out;
+    start = *offset;
+    len = min(len, lf->snapshotLen - start);
+    if (copy_to_user(buffer, lf->snapshot + start, len)) {
+        ret = -EFAULT;
+        goto out;
+    }
+    *offset += len;
+    ret = len;
+out:
+    mutex_unlock(&panel->writeLock);
+    return ret;
+}
+
+/** @brief Internal: Copies out a snapshot of the shown frame for LEDMSG_IOC_SNAPSHOT
+ *  @param filep A pointer to a file object, its format applies to the snapshot
+ *  @param us The user space struct ledmsg_snapshot
+ *  @return 0 if successful, a negative error code otherwise
+ */
+static int get_snapshot(struct file *filep, struct ledmsg_snapshot __user *us) {
+    struct ledmsg_file *lf = filep->private_data;
+    struct ledmsg_panel *panel = lf->panel;
+    struct ledmsg_snapshot snap;
+    int ret;
+
+    if (copy_from_user(&snap, us, sizeof snap))
+        return -EFAULT;
+    if (snap.flags & ~LEDMSG_SNAPSHOT_IF_CHANGED)
+        return -EINVAL;
+    if (snap.size < frame_length(panel->bus, lf->format))
+        return -ENOSPC;
+
+    ret = lock_writer(filep);
+    if (ret)
+        return ret;
+    ret = take_snapshot(filep, snap.flags & LEDMSG_SNAPSHOT_IF_CHANGED, snap.seq);
+    if (ret >= 0) {
+        snap.flags = ret ? LEDMSG_SNAPSHOT_UNCHANGED : 0;
+        snap.size = ret ? 0 : lf->snapshotLen;
+        snap.seq = lf->snapshotSeq;
+        ret = 0;
+        if (snap.size && copy_to_user(u64_to_user_ptr(snap.data), lf->snapshot, snap.size))
+            ret = -EFAULT;
+        else if (copy_to_user(us, &snap, sizeof snap))
+            ret = -EFAULT;
+    }
+    mutex_unlock(&panel->writeLock);
+    return ret;
+}
+
+/** @brief Internal: Copies, decodes and compiles a batch of frames and hands it to update_row
+ *  @param filep A pointer to a file object, its format applies to all the frames
+ *  @param uq The user space struct ledmsg_queue
+ *  @return 0 if successful, a negative error code otherwise
+ */
+static int queue_frames(struct file *filep, const struct ledmsg_queue __user *uq) {
+    struct ledmsg_file *lf = filep->private_data;
+    struct ledmsg_panel *panel = lf->panel;
+    struct ledmsg_bus *bus = panel->bus;
+    struct ledmsg_playlist *pl, *old;
+    const char __user *src;
+    struct ledmsg_queue q;
+    size_t frameLen, planeBytes;
+    unsigned int i, numPlanes;
+    u32 durationUs;
+    int ret;
+
+    if (copy_from_user(&q, uq, sizeof q))
+        return -EFAULT;
+    if (q.count == 0 || q.count > READ_ONCE(maxQueueFrames) || (q.flags & ~LEDMSG_QUEUE_LOOP))
+        return -EINVAL;
+    if (lf->format == LEDMSG_FMT_TEXT)
+        return -EINVAL;                 // Text has no fixed frame size to step through
+
+    frameLen = frame_length(bus, lf->format);
+    numPlanes = format_planes(lf->format);     // Once: the buffers below are sized for it
+    planeBytes = numPlanes * bus->canvasBytes;
+
+    pl = kzalloc(struct_size(pl, frames, q.count), GFP_KERNEL);
+    if (!pl)
+        return -ENOMEM;
+    pl->loop = q.flags & LEDMSG_QUEUE_LOOP;
+    pl->start = q.startNs > 0 ? ns_to_ktime(q.startNs) : 0;
+    pl->data = kvmalloc_array(q.count, planeBytes, GFP_KERNEL);
+    pl->durationNs = kvcalloc(q.count, sizeof *pl->durationNs, GFP_KERNEL);
+    if (!pl->data || !pl->durationNs) {
+        ret = -ENOMEM;
+        goto error;
+    }
+    for (i = 0; i < q.count; ++i) {
+        pl->frames[i].data = pl->data + i * planeBytes;
+        pl->frames[i].stream = kmalloc_array(numPlanes * bus->numRows, bus->streamSize, GFP_KERNEL);
+        if (!pl->frames[i].stream) {
+            ret = -ENOMEM;
+            goto error;
+        }
+        pl->count = i + 1;
+        if (q.durations) {
+            if (get_user(durationUs, (const u32 __user *)u64_to_user_ptr(q.durations) + i)) {
+                ret = -EFAULT;
+                goto error;
+            }
+            pl->durationNs[i] = (u64)durationUs * NSEC_PER_USEC;
+        }
+    }
+
+    ret = lock_writer(filep);
+    if (ret)
+        goto error;
+    src = u64_to_user_ptr(q.frames);
+    for (i = 0; i < q.count; ++i, src += frameLen) {
+        ret = decode_frame(panel, lf->format, src, &pl->frames[i], numPlanes);
+        if (ret) {
+            mutex_unlock(&panel->writeLock);
+            goto error;
+        }
+        ledmsg_commit_frame(panel, &pl->frames[i]);
+        pl->frames[i].seq = ++panel->frameSeq;
+    }
+
+    spin_lock(&panel->playlistLock);
+    old = panel->queuedPlaylist;
+    panel->queuedPlaylist = pl;
+    spin_unlock(&panel->playlistLock);
+    ledmsg_free_playlist(old);                 // Replaced before update_row ever saw it
+    ledmsg_free_retired_playlists(panel);
+    mutex_unlock(&panel->writeLock);
+    return 0;
+
+error:
+    ledmsg_free_playlist(pl);
+    return ret;
+}
+
+/** @brief Internal: Reports the panel and canvas sizes for LEDMSG_IOC_GET_GEOMETRY
+ *  @param panel The panel
+ *  @param ug The user space struct ledmsg_geometry to fill in
+ *  @return 0 if successful, a negative error code otherwise
+ */
+static int get_geometry(const struct ledmsg_panel *panel, struct ledmsg_geometry __user *ug) {
+    const struct ledmsg_bus *bus = panel->bus;
+    struct ledmsg_geometry g = {
+        .rows = bus->numRows,
+        .cols = bus->rowBits,
+        .canvasWidth = bus->canvasWidth,
+        .canvasHeight = bus->canvasHeight,
+        .mmapStride = bus->frameStride,
+        .grayBits = gray_planes(),
+        .panel = panel->index,
+        .numPanels = bus->numPanels,
+    };
+
+    return copy_to_user(ug, &g, sizeof g) ? -EFAULT : 0;
+}
+
+/** @brief Internal: Moves or scrolls the viewport for LEDMSG_IOC_SET_VIEWPORT
+ *  update_row picks the change up at its next frame boundary.
+ *  @param panel The panel
+ *  @param uv The user space struct ledmsg_viewport
+ *  @return 0 if successful, a negative error code otherwise
+ */
+static int set_viewport(struct ledmsg_panel *panel, const struct ledmsg_viewport __user *uv) {
+    struct ledmsg_viewport v;
+
+    if (copy_from_user(&v, uv, sizeof v))
+        return -EFAULT;
+    if (abs(v.dxPerSec) > MAX_SCROLL_SPEED || abs(v.dyPerSec) > MAX_SCROLL_SPEED)
+        return -EINVAL;                 // Keeps update_viewport's arithmetic from overflowing
+    spin_lock(&panel->viewLock);
+    panel->requestedView = v;
+    panel->requestedViewTime = ktime_get();
+    WRITE_ONCE(panel->viewGen, panel->viewGen + 1);
+    spin_unlock(&panel->viewLock);
+    return 0;
+}
+
+/** @brief Internal: Reports where the viewport is for LEDMSG_IOC_GET_VIEWPORT
+ *  @param panel The panel
+ *  @param uv The user space struct ledmsg_viewport to fill in
+ *  @return 0 if successful, a negative error code otherwise
+ */
+static int get_viewport(struct ledmsg_panel *panel, struct ledmsg_viewport __user *uv) {
+    struct ledmsg_viewport v;
+
+    spin_lock(&panel->viewLock);
+    v = panel->requestedView;
+    spin_unlock(&panel->viewLock);
+    v.x = READ_ONCE(panel->viewX);
+    v.y = READ_ONCE(panel->viewY);
+    return copy_to_user(uv, &v, sizeof v) ? -EFAULT : 0;
+}
+
+/** @brief Handles the ioctl() calls made on the device
+ *  @param filep A pointer to a file object
+ *  @param cmd One of the LEDMSG_IOC_* commands from ledmsgchar.h
+ *  @param arg The user space pointer that goes with the command
+ *  @return 0 if successful, a negative error code otherwise
+ */
+static long dev_ioctl(struct file *filep, unsigned int cmd, unsigned long arg) {
+    struct ledmsg_file *lf = filep->private_data;
+    struct ledmsg_panel *panel = lf->panel;
+    int __user *argp = (int __user *)arg;
+    struct ledmsg_playlist *pl;
+    struct ledmsg_text text;
+    int value;
+    int ret;
+
+    switch (cmd) {
+    case LEDMSG_IOC_SET_FORMAT:
+        if (get_user(value, argp))
+            return -EFAULT;
+        if (value < LEDMSG_FMT_HEX || value > LEDMSG_FMT_TEXT)
+            return -EINVAL;
+        lf->format = value;
+        return 0;
+    case LEDMSG_IOC_GET_FORMAT:
+        return put_user(lf->format, argp);
+    case LEDMSG_IOC_GET_BACK:
+        ret = lock_writer(filep);
+        if (ret)
+            return ret;
+        panel->frames[panel->back].staleRows = LEDMSG_ALL_ROWS;    // Userspace may draw into it now
+        ret = put_user(panel->back, argp);
+        mutex_unlock(&panel->writeLock);
+        return ret;
+    case LEDMSG_IOC_FLIP:
+        ret = lock_writer(filep);
+        if (ret)
+            return ret;
+        ret = wait_for_frame_slot(filep);
+        if (!ret) {
+            panel->frames[panel->back].numPlanes = format_planes(lf->format);
+            ledmsg_commit_frame(panel, &panel->frames[panel->back]);
+            ledmsg_publish_back(panel);
+            ret = put_user(panel->back, argp);
+        }
+        mutex_unlock(&panel->writeLock);
+        return ret;
+    case LEDMSG_IOC_SET_WRITE_MODE:
+        if (get_user(value, argp))
+            return -EFAULT;
+        if (value != LEDMSG_WRITE_BLOCK && value != LEDMSG_WRITE_LATEST)
+            return -EINVAL;
+        lf->writeMode = value;
+        return 0;
+    case LEDMSG_IOC_GET_WRITE_MODE:
+        return put_user(lf->writeMode, argp);
+    case LEDMSG_IOC_QUEUE:
+        return queue_frames(filep, (const struct ledmsg_queue __user *)arg);
+    case LEDMSG_IOC_GET_GEOMETRY:
+        return get_geometry(panel, (struct ledmsg_geometry __user *)arg);
+    case LEDMSG_IOC_SET_VIEWPORT:
+        return set_viewport(panel, (const struct ledmsg_viewport __user *)arg);
+    case LEDMSG_IOC_GET_VIEWPORT:
+        return get_viewport(panel, (struct ledmsg_viewport __user *)arg);
+    case LEDMSG_IOC_SET_TEXT:
+        if (copy_from_user(&text, (const void __user *)arg, sizeof text))
+            return -EFAULT;
+        if (text.flags & ~(LEDMSG_TEXT_INVERT | LEDMSG_TEXT_CENTER))
+            return -EINVAL;
+        lf->text = text;
+        return 0;
+    case LEDMSG_IOC_GET_TEXT:
+        return copy_to_user((void __user *)arg, &lf->text, sizeof lf->text) ? -EFAULT : 0;
+    case LEDMSG_IOC_WRITE_RECT:
+        return write_rect(filep, (const struct ledmsg_rect __user *)arg);
+    case LEDMSG_IOC_SNAPSHOT:
+        return get_snapshot(filep, (struct ledmsg_snapshot __user *)arg);
+    case LEDMSG_IOC_SET_LAYER:
+        return set_layer(filep, (const struct ledmsg_layer __user *)arg);
+    case LEDMSG_IOC_GET_LAYER:
+        return get_layer(filep, (struct ledmsg_layer __user *)arg);
+    case LEDMSG_IOC_QUEUE_STOP:
+        spin_lock(&panel->playlistLock);
+        pl = panel->queuedPlaylist;
+        panel->queuedPlaylist = NULL;
+        panel->stopPlaylist = true;
+        spin_unlock(&panel->playlistLock);
+        ledmsg_free_playlist(pl);
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+/** @brief Maps the page backed frame buffers into user space
+ *  The panel's frame buffers are mapped back to back, frameStride bytes apart. The page
+ *  offset selects where to start, so a process can map all of them with one
+ *  call or just the one it is interested in.
+ *  @param filep A pointer to a file object
+ *  @param vma The user space region to fill in
+ *  @return 0 if successful, a negative error code otherwise
+ */
+static int dev_mmap(struct file *filep, struct vm_area_struct *vma) {
+    struct ledmsg_file *lf = filep->private_data;
+    unsigned long numPages = (vma->vm_end - vma->vm_start) >> PAGE_SHIFT;
+    unsigned long framePages = lf->panel->bus->frameStride >> PAGE_SHIFT;
+    unsigned long i, page;
+    u8 *addr;
+    int ret;
+
+    if (vma->vm_pgoff >= NUM_FRAMES * framePages || numPages > NUM_FRAMES * framePages - vma->vm_pgoff)
+        return -EINVAL;
+
+    for (i = 0; i < numPages; ++i) {
+        page = vma->vm_pgoff + i;
+        addr = lf->panel->frames[page / framePages].data + (page % framePages) * PAGE_SIZE;
+        ret = remap_pfn_range(vma, vma->vm_start + i * PAGE_SIZE, virt_to_phys(addr) >> PAGE_SHIFT,
+                              PAGE_SIZE, vma->vm_page_prot);
+        if (ret)
+            return ret;
+    }
+    return 0;
+}
+
+/** @brief Reports whether a write() or LEDMSG_IOC_FLIP would go through without waiting
+ *  @param filep A pointer to a file object
+ *  @param wait The poll table to register frameWait with
+ *  @return The poll event mask
+ */
+static __poll_t dev_poll(struct file *filep, poll_table *wait) {
+    struct ledmsg_file *lf = filep->private_data;
+    __poll_t mask = 0;
+
+    poll_wait(filep, &lf->panel->frameWait, wait);
+    if (lf->writeMode == LEDMSG_WRITE_LATEST || !ledmsg_frame_pending(lf->panel))
+        mask |= EPOLLOUT | EPOLLWRNORM;
+    return mask;
+}
+
+/** @brief The device release function that is called whenever the device is closed/released by
+ *  the userspace program
+ *  @param inodep A pointer to an inode object (defined in linux/fs.h)
+ *  @param filep A pointer to a file object (defined in linux/fs.h)
+ */
+static int dev_release(struct inode *inodep, struct file *filep){
+   struct ledmsg_file *lf = filep->private_data;
+   struct ledmsg_panel *panel = lf->panel;
+
+   if (lf->layer) {                 // Take the layer off the sign, without waiting for a frame slot
+      mutex_lock(&panel->writeLock);
+      ledmsg_layer_free(lf->layer);
+      show_layers(panel, 0, LEDMSG_ALL_ROWS);
+      mutex_unlock(&panel->writeLock);
+   }
+   kvfree(lf->snapshot);
+   kfree(lf);
+   LOG_DEBUG("Device %u successfully closed", panel->index);
+   return 0;
+}
+
+/** @brief A module must use the module_init() module_exit() macros from linux/init.h, which
+ *  identify the initialization function at insertion time and the cleanup function (as
+ *  listed above)
+ */
+module_init(ledmsgchar_init);
+module_exit(ledmsgchar_exit);
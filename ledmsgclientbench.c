@@ -0,0 +1,357 @@
+/**
+ * @file   ledmsgclientbench.c
+ * @author David Good
+ * @date   16 October 2026
+ * @version 0.1
+ * @brief  Benchmark of the client library against /dev/ledmsgchar0, or against
+ * a FIFO standing in for it when there is no panel. Reports frames per second
+ * encoded, against sprintf("%02X") per byte, sustained frames per second with
+ * one write() per frame and with batches through writev(), and the end to end
+ * latency of a frame, from the write() until the device took it for the scan
+ * or the reader at the other end of the FIFO had all of it. Checks the
+ * encoders and exits non-zero if any is wrong.
+ * Build and run with "make clientbench".
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include "ledmsg_client.h"
+
+static const char *devPath = "/dev/ledmsgchar0";    ///< -d, the device to write to
+static bool forceFifo;                              ///< -f, write to a FIFO even if the device exists
+static int format = LEDMSG_FMT_HEX;                 ///< -x, hex, binary or gray
+static unsigned long numFrames = 20000;             ///< -n, frames written per test
+static unsigned int batch = 32;                     ///< -b, frames per writev()
+static int writeMode = LEDMSG_WRITE_LATEST;         ///< -w, block or latest, for the throughput tests
+static unsigned int numSamples = 1000;              ///< -l, frames timed end to end
+
+/** @brief The reading end of the FIFO standing in for the device */
+struct fifo_reader {
+    int fd;                             ///< Read end of the FIFO
+    size_t frameSize;                   ///< Bytes per frame
+    unsigned long frames;               ///< Whole frames read so far
+    pthread_mutex_t lock;               ///< Protects frames
+    pthread_cond_t cond;                ///< Signalled each time a frame is read
+};
+
+/** @brief Internal: Seconds since some fixed point, for timing the tests */
+static double now_sec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** @brief Internal: Fills an image with a repeatable pattern
+ *  @param img The image
+ *  @param seed Picks the pattern
+ */
+static void fill_pattern(struct ledmsg_image *img, unsigned int seed) {
+    size_t i;
+
+    for (i = 0; i < (size_t)img->rowBytes * img->height; ++i) {
+        seed = seed * 1103515245 + 12345;
+        img->data[i] = seed >> 16;
+    }
+}
+
+/** @brief Internal: Encodes hex with sprintf() per byte, like testledmsgchar.c used to
+ *  @param img The image
+ *  @param out Room for the characters and a NUL
+ */
+static void encode_hex_sprintf(const struct ledmsg_image *img, char *out) {
+    size_t i;
+
+    for (i = 0; i < (size_t)img->rowBytes * img->height; ++i, out += 2)
+        sprintf(out, "%02X", img->data[i]);
+}
+
+/** @brief Internal: Checks the encoders against sprintf() and ledmsg_get_pixel()
+ *  @param img A patterned image
+ *  @return The number of bytes encoded wrong
+ */
+static unsigned int check_encoders(const struct ledmsg_image *img) {
+    size_t numBytes = (size_t)img->rowBytes * img->height;
+    char *hex = malloc(numBytes * 2 + 1), *expect = malloc(numBytes * 2 + 1);
+    uint8_t *out = malloc(numBytes * 8);
+    unsigned int x, y, bad = 0;
+    size_t i;
+
+    ledmsg_image_encode_hex(img, hex);
+    encode_hex_sprintf(img, expect);
+    for (i = 0; i < numBytes * 2; ++i)
+        bad += hex[i] != expect[i];
+    ledmsg_image_encode_binary(img, out);
+    bad += memcmp(out, img->data, numBytes) != 0;
+    ledmsg_image_encode_gray(img, out);
+    for (y = 0; y < img->height; ++y)
+        for (x = 0; x < img->rowBytes * 8; ++x)
+            bad += out[y * img->rowBytes * 8 + x] != (ledmsg_get_pixel(img, x, y) ? 0xff : 0x00);
+    free(hex);
+    free(expect);
+    free(out);
+    return bad;
+}
+
+/** @brief Internal: Drains the FIFO, counting whole frames
+ *  @param arg The struct fifo_reader
+ *  @return NULL once the writer closed the FIFO
+ */
+static void *fifo_read(void *arg) {
+    struct fifo_reader *reader = arg;
+    size_t partial = 0;
+    char buf[65536];
+    ssize_t n;
+
+    while ((n = read(reader->fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR)) {
+        if (n < 0)
+            continue;
+        partial += n;
+        if (partial >= reader->frameSize) {
+            pthread_mutex_lock(&reader->lock);
+            reader->frames += partial / reader->frameSize;
+            pthread_cond_broadcast(&reader->cond);
+            pthread_mutex_unlock(&reader->lock);
+            partial %= reader->frameSize;
+        }
+    }
+    return NULL;
+}
+
+/** @brief Internal: Waits until a number of frames written were taken
+ *  The device is polled for POLLOUT, which in LEDMSG_WRITE_BLOCK mode means
+ *  the pending frame went to the scan. The FIFO's reader counts what it read.
+ *
+ *  @param client The client
+ *  @param reader The FIFO's reader, NULL for a device
+ *  @param frames Frames written in total
+ *  @return 0 if successful, a negative errno otherwise
+ */
+static int wait_taken(struct ledmsg_client *client, struct fifo_reader *reader, unsigned long frames) {
+    struct pollfd pfd = { .fd = client->fd, .events = POLLOUT };
+
+    if (!reader) {
+        if (poll(&pfd, 1, 1000) < 0)
+            return -errno;
+        return pfd.revents & POLLOUT ? 0 : -ETIMEDOUT;
+    }
+    pthread_mutex_lock(&reader->lock);
+    while (reader->frames < frames)
+        pthread_cond_wait(&reader->cond, &reader->lock);
+    pthread_mutex_unlock(&reader->lock);
+    return 0;
+}
+
+/** @brief Internal: Sorts latencies with qsort() */
+static int compare_doubles(const void *a, const void *b) {
+    double da = *(const double *)a, db = *(const double *)b;
+
+    return (da > db) - (da < db);
+}
+
+int main(int argc, char **argv) {
+    static const char *formatNames[] = { "hex", "binary", "gray" };
+    struct ledmsg_client client;
+    struct fifo_reader fifo = { .fd = -1 };
+    struct fifo_reader *reader = NULL;
+    struct ledmsg_image *imgs = NULL;
+    struct stat st;
+    pthread_t readerThread;
+    char fifoDir[] = "/tmp/ledmsgXXXXXX";
+    char fifoPath[sizeof(fifoDir) + 8] = "";
+    char *hex;
+    uint8_t *out;
+    double start, hexSec, sprintfSec, binarySec, graySec, writeSec, batchSec;
+    double *latency = NULL;
+    unsigned long i, batchFrames = 0, written = 0;
+    unsigned int k, bad;
+    bool useFifo;
+    int opt, fd, mode, err, ret = 1;
+
+    while ((opt = getopt(argc, argv, "d:fx:n:b:w:l:")) != -1) {
+        switch (opt) {
+        case 'd': devPath = optarg; break;
+        case 'f': forceFifo = true; break;
+        case 'x':
+            for (k = LEDMSG_FMT_HEX; k <= LEDMSG_FMT_GRAY && strcmp(optarg, formatNames[k]); ++k)
+                ;
+            format = k;
+            break;
+        case 'n': numFrames = strtoul(optarg, NULL, 0) ?: 1; break;
+        case 'b': batch = strtoul(optarg, NULL, 0) ?: 1; break;
+        case 'w': writeMode = strcmp(optarg, "block") ? LEDMSG_WRITE_LATEST : LEDMSG_WRITE_BLOCK; break;
+        case 'l': numSamples = strtoul(optarg, NULL, 0) ?: 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-d device] [-f] [-x hex|binary|gray] [-n frames] [-b batch]"
+                            " [-w block|latest] [-l samples]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (format > LEDMSG_FMT_GRAY) {
+        fprintf(stderr, "unknown format\n");
+        return 2;
+    }
+
+    // No panel here, so a FIFO with a thread reading it stands in for one
+    useFifo = forceFifo || stat(devPath, &st) || !S_ISCHR(st.st_mode);
+    if (useFifo) {
+        if (!mkdtemp(fifoDir)) {
+            perror("mkdtemp");
+            return 1;
+        }
+        snprintf(fifoPath, sizeof(fifoPath), "%s/fifo", fifoDir);
+        // O_RDWR so neither end's open() waits for the other
+        if (mkfifo(fifoPath, 0600) || (fifo.fd = open(fifoPath, O_RDWR)) < 0) {
+            perror(fifoPath);
+            goto out_dir;
+        }
+        devPath = fifoPath;
+    }
+    err = ledmsg_open(&client, devPath, format);
+    if (err) {
+        fprintf(stderr, "failed to open %s: %s\n", devPath, strerror(-err));
+        goto out_dir;
+    }
+    if (useFifo) {
+        // Only the reader keeps the FIFO open for reading, so it sees EOF after ledmsg_close()
+        fd = open(fifoPath, O_RDONLY);
+        close(fifo.fd);
+        fifo.fd = fd;
+        if (fd < 0) {
+            perror(fifoPath);
+            goto out_close;
+        }
+        fifo.frameSize = client.frameSize;
+        pthread_mutex_init(&fifo.lock, NULL);
+        pthread_cond_init(&fifo.cond, NULL);
+        pthread_create(&readerThread, NULL, fifo_read, &fifo);
+        reader = &fifo;
+    } else if (ioctl(client.fd, LEDMSG_IOC_SET_WRITE_MODE, &writeMode)) {
+        perror("LEDMSG_IOC_SET_WRITE_MODE");
+        goto out_close;
+    }
+    printf("%s: %s, %u x %u canvas, %s frames of %zu bytes\n", reader ? "fifo" : "device", devPath,
+           client.geometry.canvasWidth, client.geometry.canvasHeight, formatNames[format], client.frameSize);
+
+    imgs = calloc(batch, sizeof(*imgs));
+    for (k = 0; k < batch; ++k) {
+        if (ledmsg_frame_image(&client, &imgs[k])) {
+            fprintf(stderr, "out of memory\n");
+            goto out_close;
+        }
+        fill_pattern(&imgs[k], k + 1);
+    }
+
+    // Encoding on its own, against sprintf() per byte
+    hex = malloc(client.frameSize * 8 + 1);
+    out = (uint8_t *)hex;
+    start = now_sec();
+    for (i = 0; i < numFrames; ++i)
+        ledmsg_image_encode_hex(&imgs[i % batch], hex);
+    hexSec = now_sec() - start;
+    start = now_sec();
+    for (i = 0; i < numFrames; ++i)
+        encode_hex_sprintf(&imgs[i % batch], hex);
+    sprintfSec = now_sec() - start;
+    start = now_sec();
+    for (i = 0; i < numFrames; ++i)
+        ledmsg_image_encode_binary(&imgs[i % batch], out);
+    binarySec = now_sec() - start;
+    start = now_sec();
+    for (i = 0; i < numFrames; ++i)
+        ledmsg_image_encode_gray(&imgs[i % batch], out);
+    graySec = now_sec() - start;
+    free(hex);
+    printf("encode: hex %.0f frames/s (sprintf %.0f), binary %.0f, gray %.0f\n",
+           numFrames / hexSec, numFrames / sprintfSec, numFrames / binarySec, numFrames / graySec);
+    bad = check_encoders(&imgs[0]);
+    printf("encoder check: %s (%u bad bytes)\n", bad ? "FAILED" : "ok", bad);
+    if (bad)
+        goto out_close;
+
+    // Sustained rate, one frame per write()
+    start = now_sec();
+    for (i = 0; i < numFrames; ++i) {
+        err = ledmsg_write_frame(&client, &imgs[i % batch]);
+        if (err)
+            goto out_write;
+    }
+    written += numFrames;
+    if (reader)
+        wait_taken(&client, reader, written);
+    writeSec = now_sec() - start;
+
+    // Sustained rate, batch frames per writev()
+    start = now_sec();
+    for (i = 0; i < numFrames; i += batch) {
+        err = ledmsg_write_frames(&client, imgs, batch);
+        if (err)
+            goto out_write;
+        batchFrames += batch;
+    }
+    written += batchFrames;
+    if (reader)
+        wait_taken(&client, reader, written);
+    batchSec = now_sec() - start;
+    printf("write: %.0f frames/s one per write(), %.0f frames/s in batches of %u%s\n",
+           numFrames / writeSec, batchFrames / batchSec, batch,
+           reader || writeMode == LEDMSG_WRITE_BLOCK ? "" : " (latest mode, not all shown)");
+
+    // End to end, each frame on its own until it was taken
+    if (!reader) {
+        mode = LEDMSG_WRITE_BLOCK;
+        if (ioctl(client.fd, LEDMSG_IOC_SET_WRITE_MODE, &mode)) {
+            perror("LEDMSG_IOC_SET_WRITE_MODE");
+            goto out_close;
+        }
+        err = wait_taken(&client, reader, 0);
+        if (err)
+            goto out_write;
+    }
+    latency = malloc(numSamples * sizeof(*latency));
+    for (k = 0; k < numSamples; ++k) {
+        start = now_sec();
+        err = ledmsg_write_frame(&client, &imgs[k % batch]);
+        if (!err)
+            err = wait_taken(&client, reader, ++written);
+        if (err)
+            goto out_write;
+        latency[k] = (now_sec() - start) * 1e6;
+    }
+    qsort(latency, numSamples, sizeof(*latency), compare_doubles);
+    printf("latency: min %.1f us, median %.1f us, p99 %.1f us, max %.1f us over %u frames\n",
+           latency[0], latency[numSamples / 2], latency[numSamples * 99 / 100], latency[numSamples - 1],
+           numSamples);
+    ret = 0;
+    goto out_close;
+
+out_write:
+    fprintf(stderr, "failed to write to %s: %s\n", devPath, strerror(-err));
+out_close:
+    ledmsg_close(&client);
+    if (reader)
+        pthread_join(readerThread, NULL);
+    free(latency);
+    if (imgs)
+        for (k = 0; k < batch; ++k)
+            ledmsg_image_free(&imgs[k]);
+    free(imgs);
+out_dir:
+    if (fifo.fd >= 0)
+        close(fifo.fd);
+    if (fifoPath[0]) {
+        unlink(fifoPath);
+        rmdir(fifoDir);
+    }
+    return ret;
+}
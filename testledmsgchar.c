@@ -4,60 +4,31 @@
  * @date   20-03-2016
  * @version 0.1
  * @brief  A Linux user space program that communicates with the ledmsgchar LKM.
- * It passes strings to the LKM representing buffers. For this example to work
- * the device must be called /dev/ledmsgchar.
+ * It cycles the panel through lit rows and columns, one pattern a second,
+ * built and written with the client library. For this example to work the
+ * device must be called /dev/ledmsgchar0, the first panel.
  */
 #include <stdio.h>
-#include <stdlib.h>
-#include <errno.h>
-#include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
-
-#define NUM_ROWS       8
-#define NUM_ROW_BYTES 18
-#define STRING_LENGTH ((NUM_ROWS * NUM_ROW_BYTES * 2) + 1)
-
-static void fill_row(unsigned int row, char *str) {
-    unsigned int r, i;
-
-    for (r = 0; r < NUM_ROWS; ++r) {
-        for (i = 0; i < NUM_ROW_BYTES; ++i) {
-            if (r == row) {
-                memcpy(str, "FF", 2);
-            } else {
-                memcpy(str, "00", 2);
-            }
-            str += 2;
-        }
-    }
-    *str = 0;
-}
-
-static void fill_cols(unsigned int col, char *str) {
-    unsigned int r, i;
-
-    for (r = 0; r < NUM_ROWS; ++r) {
-        for (i = 0; i < NUM_ROW_BYTES; ++i) {
-            sprintf(str, "%02X", (unsigned int)(1 << col));
-            str += 2;
-        }
-    }
-    *str = 0;
-}
+#include "ledmsg_client.h"
 
 int main() {
-    int ret, fd;
-    char *dev_name = "/dev/ledmsgchar";
-    unsigned int pattern = 0;
-
-    char hexStr[((NUM_ROWS * NUM_ROW_BYTES * 2) + 1)];
+    struct ledmsg_client client;
+    struct ledmsg_image frame;
+    const char *dev_name = "/dev/ledmsgchar0";
+    unsigned int pattern = 0, x;
+    int ret;
 
     printf("Opening device %s...\n", dev_name);
-    fd = open(dev_name, O_RDWR);        // Open the device with read/write access
-    if (fd < 0) {
-        perror("Failed to open the device...");
-        return errno;
+    ret = ledmsg_open(&client, dev_name, LEDMSG_FMT_HEX);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to open the device: %s\n", strerror(-ret));
+        return -ret;
+    }
+    if (ledmsg_frame_image(&client, &frame)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
     }
 
     while (1) {
@@ -66,58 +37,20 @@ int main() {
             COL_0, COL_1, COL_2, COL_3, COL_4, COL_5, COL_6, COL_7,
         };
 
+        ledmsg_image_clear(&frame, false);
         if (pattern <= ROW_7) {
-            fill_row(pattern, hexStr);
-            /* printf("row %d: %s\n", pattern, hexStr); */
-        } else if (pattern <= COL_7) {
-            fill_cols(pattern - 8, hexStr);
-            /* printf("col %d: %s\n", pattern - 8, hexStr); */
+            ledmsg_fill_row(&frame, pattern, true);
         } else {
-            printf("invalid pattern %d\n", pattern);
+            // Bit n of every byte, like the hex string "0101..." for COL_0
+            for (x = 7 - (pattern - COL_0); x < frame.width; x += 8)
+                ledmsg_fill_col(&frame, x, true);
         }
 
-        /* printf("before switch pattern = %d\n", pattern); */
-        /* switch (pattern) { */
-        /* ROW_0: */
-        /*     printf("pattern = %d\n", pattern); */
-        /*     break; */
-        /* ROW_1: */
-        /*     printf("pattern = %d\n", pattern); */
-        /*     break; */
-        /* ROW_2: */
-        /*     printf("pattern = %d\n", pattern); */
-        /* ROW_3: */
-        /*     printf("pattern = %d\n", pattern); */
-        /* ROW_4: */
-        /*     printf("pattern = %d\n", pattern); */
-        /* ROW_5: */
-        /*     printf("pattern = %d\n", pattern); */
-        /* ROW_6: */
-        /*     printf("pattern = %d\n", pattern); */
-        /* ROW_7: */
-        /*     printf("pattern = %d\n", pattern); */
-        /*     /\* fill_row(pattern, hexStr); *\/ */
-        /*     break; */
-        /* COL_0: */
-        /* COL_1: */
-        /* COL_2: */
-        /* COL_3: */
-        /* COL_4: */
-        /* COL_5: */
-        /* COL_6: */
-        /* COL_7: */
-        /*     /\* fill_cols(pattern - 8, hexStr); *\/ */
-        /*     break; */
-        /* default: */
-        /*     printf("Hit Default! pattern = %d\n", pattern); */
-        /*     pattern = ROW_0; */
-        /*     printf("pattern = %d\n", pattern); */
-        /* } */
-        printf("Pattern %d: %s\n", pattern, hexStr);
-        ret = write(fd, hexStr, strlen(hexStr));
+        printf("Pattern %d\n", pattern);
+        ret = ledmsg_write_frame(&client, &frame);
         if (ret < 0) {
-            perror("Failed to write to the device.");
-            return errno;
+            fprintf(stderr, "Failed to write to the device: %s\n", strerror(-ret));
+            return -ret;
         }
         sleep(1);
         if (pattern < COL_7) {
@@ -125,22 +58,5 @@ int main() {
         } else {
             pattern = ROW_0;
         }
-        /* if (pattern < 15) { */
-        /*     ++pattern; */
-        /* } else { */
-        /*     pattern = 0; */
-        /* } */
     }
-    /* printf("Press ENTER to read back from the device...\n"); */
-    /* getchar(); */
-
-    /* printf("Reading from the device...\n"); */
-    /* ret = read(fd, receive, BUFFER_LENGTH);        // Read the response from the LKM */
-    /* if (ret < 0){ */
-    /*     perror("Failed to read the message from the device."); */
-    /*     return errno; */
-    /* } */
-    /* printf("The received message is: [%s]\n", receive); */
-    /* printf("End of the program\n"); */
-    /* return 0; */
 }